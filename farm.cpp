@@ -0,0 +1,126 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "headers/emu.hpp"
+#include "headers/work_pool.hpp"
+
+// Headless batch runner: runs every ROM given on the command line or in a
+// list file for a fixed budget, spread over all cores, then reports how each
+// one ended and what it printed over the serial port.
+
+typedef struct {
+    std::string path;
+    ExitReason reason;
+    u64 cycles;
+    u64 instructions;
+    double seconds;
+    std::string serial;
+} FarmResult;
+
+typedef struct {
+    u64 max_cycles;
+    std::vector<FarmResult> results;
+} Farm;
+
+static void run_rom(void* ctx, size_t index) {
+    Farm* farm = static_cast<Farm*>(ctx);
+    FarmResult& result = farm->results[index];
+
+    Emulator emu(TraceLevel::OFF);      // the serial text is reported from the Bus instead
+
+    auto start = std::chrono::steady_clock::now();
+    result.reason = ExitReason::LOAD_FAILED;
+    if (emu.load(result.path)) {
+        emu.get_bus()->set_render_interval(0);  // nothing looks at the screen
+        result.reason = emu.run(farm->max_cycles);
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.cycles = emu.cycles();
+    result.instructions = emu.instructions();
+    if (emu.get_bus()) {
+        result.serial = emu.get_bus()->serial_text();
+    }
+}
+
+static bool read_list(const char* path, std::vector<FarmResult>& results) {
+    std::ifstream list(path);
+    if (!list) {
+        std::cerr << "Error: Unable to open ROM list " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty() && line[0] != '#') {
+            results.push_back(FarmResult{line});
+        }
+    }
+    return true;
+}
+
+static void usage() {
+    std::cerr << "usage: zenboy_farm [--frames N | --cycles N] [--jobs N] [--list FILE] ROM..." << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    Farm farm;
+    farm.max_cycles = 3600ull * FRAME_CYCLES;  // a minute of emulated time
+    unsigned jobs = 0;
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--frames") == 0 && has_value) {
+            farm.max_cycles = std::strtoull(argv[++i], nullptr, 0) * FRAME_CYCLES;
+        } else if (std::strcmp(argv[i], "--cycles") == 0 && has_value) {
+            farm.max_cycles = std::strtoull(argv[++i], nullptr, 0);
+        } else if (std::strcmp(argv[i], "--jobs") == 0 && has_value) {
+            jobs = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (std::strcmp(argv[i], "--list") == 0 && has_value) {
+            if (!read_list(argv[++i], farm.results)) {
+                return 1;
+            }
+        } else if (argv[i][0] == '-') {
+            usage();
+            return 1;
+        } else {
+            farm.results.push_back(FarmResult{argv[i]});
+        }
+    }
+    if (farm.results.empty()) {
+        usage();
+        return 1;
+    }
+
+    WorkPool pool(jobs);
+    auto start = std::chrono::steady_clock::now();
+    pool.run(farm.results.size(), run_rom, &farm);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t counts[5] = {};
+    for (const FarmResult& result : farm.results) {
+        counts[static_cast<size_t>(result.reason)]++;
+        double ips = result.seconds > 0 ? result.instructions / result.seconds : 0;
+        std::printf("== %s\n%s: %llu cycles, %llu instructions in %.3f s, %.2f M instr/s\n",
+                    result.path.c_str(), exit_reason_name(result.reason),
+                    static_cast<unsigned long long>(result.cycles),
+                    static_cast<unsigned long long>(result.instructions), result.seconds, ips / 1e6);
+        if (!result.serial.empty()) {
+            std::printf("%s%s", result.serial.c_str(), result.serial.back() == '\n' ? "" : "\n");
+        }
+    }
+    std::printf("%zu ROMs on %u threads in %.3f s: %zu passed, %zu failed, %zu stopped, %zu out of budget, %zu not loaded\n",
+                farm.results.size(), pool.size(), seconds,
+                counts[static_cast<size_t>(ExitReason::PASSED)], counts[static_cast<size_t>(ExitReason::FAILED)],
+                counts[static_cast<size_t>(ExitReason::STOPPED)], counts[static_cast<size_t>(ExitReason::BUDGET)],
+                counts[static_cast<size_t>(ExitReason::LOAD_FAILED)]);
+
+    bool ok = counts[static_cast<size_t>(ExitReason::FAILED)] == 0 &&
+              counts[static_cast<size_t>(ExitReason::STOPPED)] == 0 &&
+              counts[static_cast<size_t>(ExitReason::LOAD_FAILED)] == 0;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+#include "emu.hpp"
+#include "instructions.hpp"
+
+// Many instances ("lanes") of one ROM stepped together a frame at a time,
+// for reinforcement learning and fuzzing. Every lane is a full Emulator;
+// they share the ROM image and nothing else.
+//
+// Lanes that are about to run the same straight line of register-only ROM
+// code (the instructions the JIT translates, minus the closing branch) run
+// it once for all of them: their registers are copied into one array per
+// register, each instruction is a loop over the lanes that the compiler
+// turns into SIMD, and the results are copied back. As with native blocks
+// the per-instruction epilogue is skipped, which needs each lane to be
+// unable to take an interrupt before the run ends (gbCpu::quiet_for).
+// Every other instruction, and every lane that shares its PC with no other
+// lane, runs on the lane's own gbCpu, so a lane ends up exactly where it
+// would have running alone.
+class Batch {
+    public:
+        // Lanes are stepped a tile at a time so the working set of the
+        // lanes being interleaved stays in cache. It is also the width of
+        // every loop over lanes.
+        static constexpr size_t TILE_LANES = 32;
+
+        Batch(const std::string& rom_path, size_t lanes, TraceLevel trace_level = TraceLevel::OFF);
+
+        bool loaded() const { return ok; }
+        size_t size() const { return lanes.size(); }
+        Emulator& lane(size_t index) { return *lanes[index]; }
+
+        // Runs each lane until it has advanced frames frames from where it
+        // was, or it stops.
+        void run_frames(u32 frames);
+
+        // Instructions run across all lanes, and how many of them ran as
+        // part of a lockstep run.
+        u64 instructions() const;
+        u64 lockstep_instructions() const { return lockstep; }
+
+    private:
+        static constexpr size_t MAX_RUN_OPS = 32;
+        static constexpr size_t MIN_RUN_OPS = 2;
+        static constexpr size_t MIN_RUN_LANES = 2;
+        // Instructions a lane runs on its own before it is regrouped.
+        static constexpr u32 MAX_SOLO_STEPS = 64;
+        static constexpr size_t RECENT_RUNS = 4096;
+
+        typedef struct {
+            const InstructionData* ins;
+            u16 imm;
+        } RunOp;
+
+        // Register-only instructions starting at a ROM address.
+        typedef struct {
+            u32 key;
+            std::vector<RunOp> ops;
+            u16 end;                // PC after the last op
+            u32 cycles;
+        } Run;
+
+        std::vector<std::unique_ptr<Emulator>> lanes;
+        bool ok = true;
+
+        // Parts of each lane, looked up once; run_frames touches every lane
+        // on every round.
+        std::vector<gbCpu*> cpus;
+        std::vector<Bus*> buses;
+        std::vector<Scheduler*> scheds;
+
+        std::unordered_map<u32, Run> runs;     // by BlockCache::key of the start
+        std::vector<const Run*> recent;         // direct-mapped front for runs
+        u64 lockstep = 0;
+
+        // Per-lane state of run_frames.
+        std::vector<u64> targets;
+        std::vector<u64> keys;      // run key << 32 | lane, sorted to group lanes
+        std::vector<u32> group;
+
+        // Registers of the lanes in a group, one array per register. Lanes
+        // past the group's size hold leftovers and are computed and ignored.
+        typedef struct {
+            u8 a[TILE_LANES], f[TILE_LANES], b[TILE_LANES], c[TILE_LANES];
+            u8 d[TILE_LANES], e[TILE_LANES], h[TILE_LANES], l[TILE_LANES];
+            u16 sp[TILE_LANES];
+        } LaneRegs;
+        LaneRegs soa = {};
+
+        u64 lane_key(u32 lane) const;
+        const Run& run_at(Bus& bus, u16 pc, u32 key);
+        void run_tile(u32 begin, u32 end);
+        void step_group(const Run& run, const u32* members, size_t count);
+        void run_solo(u32 lane);
+        void execute(const RunOp& op);
+        u8* reg8(RT reg);
+};
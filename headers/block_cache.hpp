@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "instructions.hpp"
+#include "common.hpp"
+
+class gbCpu;
+
+// Pre-bound instruction handler: one indirect call decodes the operands for
+// the opcode's addressing mode and executes it.
+typedef void (*OpHandler)(gbCpu&);
+
+// Told when a 256-byte page gets its first cached block or loses its last.
+typedef void (*PageWatchHandler)(void* ctx, u8 page, bool watched);
+
+// One decoded instruction of a basic block. The operand bytes are fetched
+// when the block is built, so executing it never goes back to Bus::read.
+typedef struct {
+    OpHandler handler;          // prefetched-operand flavour of the handler
+    const InstructionData* ins;
+    u16 pc;                     // address of the opcode byte
+    u16 imm;                    // operand bytes, little-endian
+    u8 opcode;
+    u8 length;                  // opcode + operand bytes
+} MicroOp;
+
+typedef struct {
+    u16 start;
+    u16 end;                    // one past the last byte of the block
+    std::vector<MicroOp> ops;
+
+    // Native translation of the block's leading ops, see Jit.
+    u32 hits;
+    void* native;
+    u32 native_epoch;
+    u8 native_ops;
+    u16 native_cycles;          // most M-cycles the native code can consume
+} Block;
+
+// Cache of decoded basic blocks keyed by PC and the ROM bank mapped at that PC.
+// Writes that overlap a cached block drop it; generation() changes whenever a
+// block is dropped or the ROM banks are remapped, so callers holding a Block*
+// know to look it up again.
+class BlockCache {
+    public:
+        static const size_t MAX_BLOCK_OPS = 64;
+
+        static u32 key(u16 pc, u16 bank) { return (static_cast<u32>(bank) << 16) | pc; }
+
+        Block* lookup(u32 key) const;
+        Block* insert(u32 key, Block block);
+        void invalidate(u16 address);
+        void invalidate_page(u8 page);
+        void clear();
+        void set_page_watcher(PageWatchHandler handler, void* ctx);
+        // The banks mapped into the ROM windows changed; Block pointers held
+        // for banked code must be looked up again.
+        void remap() { gen++; }
+
+        u32 generation() const { return gen; }
+
+    private:
+        std::unordered_map<u32, std::unique_ptr<Block>> blocks;
+        std::array<std::vector<u32>, 256> page_keys;
+        std::array<u16, 256> page_refs = {};
+        u32 gen = 0;
+        PageWatchHandler watcher = nullptr;
+        void* watcher_ctx = nullptr;
+
+        void watch(int page, bool watched);
+
+        void erase(u32 key);
+};
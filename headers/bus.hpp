@@ -1,40 +1,119 @@
 #pragma once
 #include "cart.hpp"
+#include "mbc.hpp"
+#include "ppu.hpp"
 #include "cpu.hpp"
 #include "timer.hpp"
 #include "common.hpp"
+#include "block_cache.hpp"
+#include "scheduler.hpp"
+#include "save_state.hpp"
+#include "trace.hpp"
 #include <cstdint>
+#include <string>
 
 class gbCpu;
 class Timer;
 
+// M-cycles for an 8-bit transfer on the internal 8192 Hz serial clock.
+const u32 SERIAL_TRANSFER_CYCLES = 1024;
+
 const size_t GB_MEMORY_SIZE = 65536; // Example size, adjust as needed
 
+// Why accesses to a page leave the fast path.
+enum PageFlags : u8 {
+    PAGE_IO = 1,        // I/O registers or unmapped memory, see read_slow/write_slow
+    PAGE_MBC = 2,       // writes go to the memory bank controller
+    PAGE_WATCHED = 4,   // holds cached code, writes invalidate it
+    PAGE_VRAM = 8       // VRAM, writes go through the PPU to its renderer
+};
+
+// A 256-byte page of the address space.
+typedef struct {
+    u8* mem;            // host memory backing the page, nullptr if none
+    u8 flags;           // PageFlags
+} Page;
+
 class Bus {
     private:
         gbCpu* cpu;
         Timer* tmr;
-        std::vector<uint8_t> memory;
+        BlockCache* code_cache = nullptr;
+        Scheduler* sched = nullptr;
+        Trace* trace = nullptr;
+        std::shared_ptr<const RomImage> rom;   // shared with other instances
+        std::vector<uint8_t> cart_ram;          // per instance
+        Mbc mbc;
+        Ppu ppu;                                // owns VRAM and OAM
         uint8_t wram[0x2000];
         uint8_t hram[0x80];
-        uint8_t hram_read(uint16_t address);
-        uint8_t wram_read(uint16_t address);
-        void hram_write(uint16_t address, uint8_t value);
-        void wram_write(uint16_t address, uint8_t value);
+        uint8_t serial_data[2] = {};    // SB, SC
+        std::string serial_log;         // every byte sent, not part of save states
+
+        // Page table. read_map/write_map hold the page's memory when the
+        // access needs no special handling and nullptr otherwise.
+        Page pages[256] = {};
+        u8* read_map[256];
+        u8* write_map[256];
+
+        void map_page(u8 page, u8* mem, u8 flags);
+        void update_page(u8 page);
+        void map_banks();
+        u8 read_slow(u16 address);
+        void write_slow(u16 address, u8 value);
         void io_write(u16 address, u8 value);
         u8 io_read(u16 address);
+        static void on_serial_done(void* ctx, u64 when);
+        static void on_page_watch(void* ctx, u8 page, bool watched);
+        void set_watched(u8 page, bool watched);
     
     public:
         Bus(Cart& cart_in, Timer* tmr_ptr = nullptr, gbCpu* cpu_ptr=nullptr);
+        Bus(const Bus&) = delete;   // the page table points into this object
+        Bus& operator=(const Bus&) = delete;
         void set_cpu(gbCpu* cpu_ptr);
+        void set_block_cache(BlockCache* cache);
+        void set_scheduler(Scheduler* sched_ptr);
+        void set_trace(Trace* trace_ptr);
+        u16 rom_bank_at(u16 address) const;
         uint8_t get_ie_register();
         void set_ie_register(uint8_t value);
         uint8_t read(uint16_t address);
+        u64 read_stable_until(uint16_t address, u64 from) const;
+        size_t cart_ram_size() const { return cart_ram.size(); }
+        // Bytes sent over the serial port since power on; test ROMs print
+        // their results there.
+        const std::string& serial_text() const { return serial_log; }
+        size_t rom_size() const { return rom->size(); }
+        u32 rom_hash() const { return rom->hash(); }
+        Ppu& get_ppu() { return ppu; }
+        void set_render_interval(u32 frames);
+
+        size_t state_size() const;
+        void save_state(StateWriter& out) const;
+        void load_state(StateReader& in);
         uint16_t read16(uint16_t address);
         void write(uint16_t address, uint8_t value);
         void write16(uint16_t address, uint16_t value);
     };
 
+inline uint8_t Bus::read(uint16_t address) {
+    const u8* page = read_map[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
+    }
+    return read_slow(address);
+}
+
+inline void Bus::write(uint16_t address, uint8_t value) {
+    u8* page = write_map[address >> 8];
+    if (page) {
+        page[address & 0xFF] = value;
+        return;
+    }
+    write_slow(address, value);
+}
+
 // Memory map
 enum MemoryMap {
     ROM_BANK_00       = 0x0000,
@@ -1,14 +1,19 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <common.hpp>
-#include <vector>
+
+#include "mbc.hpp"
+#include "rom_image.hpp"
 
 class Cart{
     private:
-        std::vector<u8> romData;
+        std::shared_ptr<const RomImage> rom;
     public:
         int read_rom(const std::string& path);
-        std::vector<u8> get_rom_data();
+        std::shared_ptr<const RomImage> get_rom() const;
+        MbcType mbc_type() const;
+        size_t ram_size() const;
 
 };
\ No newline at end of file
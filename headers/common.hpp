@@ -7,3 +7,6 @@ typedef uint16_t u16;
 typedef uint32_t u32;
 typedef uint64_t u64;
 typedef int8_t s8;
+
+// M-cycles per video frame, 154 lines of 114.
+const u32 FRAME_CYCLES = 17556;
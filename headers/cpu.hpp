@@ -1,8 +1,18 @@
 #pragma  once
 
+#include <array>
+#include <cstddef>
+#include <iostream>
+#include <utility>
+
 #include "instructions.hpp"
+#include "block_cache.hpp"
+#include "jit.hpp"
 #include "bus.hpp"
 #include "timer.hpp"
+#include "scheduler.hpp"
+#include "trace.hpp"
+#include "save_state.hpp"
 #include "common.hpp"
 
 typedef enum {
@@ -15,57 +25,246 @@ typedef enum {
 
 class Bus;
 
+// Expands X(h, l) once for every opcode 0xhl.
+#define ZB_ROW(X, h) \
+    X(h, 0) X(h, 1) X(h, 2) X(h, 3) X(h, 4) X(h, 5) X(h, 6) X(h, 7) \
+    X(h, 8) X(h, 9) X(h, A) X(h, B) X(h, C) X(h, D) X(h, E) X(h, F)
+
+#define ZB_OPCODES(X) \
+    ZB_ROW(X, 0) ZB_ROW(X, 1) ZB_ROW(X, 2) ZB_ROW(X, 3) \
+    ZB_ROW(X, 4) ZB_ROW(X, 5) ZB_ROW(X, 6) ZB_ROW(X, 7) \
+    ZB_ROW(X, 8) ZB_ROW(X, 9) ZB_ROW(X, A) ZB_ROW(X, B) \
+    ZB_ROW(X, C) ZB_ROW(X, D) ZB_ROW(X, E) ZB_ROW(X, F)
+
+typedef struct {
+    OpHandler handler;          // reads its operands through Bus::read
+    OpHandler block_handler;    // takes its operands from a MicroOp
+    const InstructionData* ins;
+    u8 length;                  // opcode + operand bytes
+    u8 cycles;                  // INSTRUCTION_TABLE cycles, 0 for illegal opcodes
+} DispatchEntry;
+
+// ALU operation whose Z/N/H/C result has not been written to F yet.
+enum class FlagOp : u8 {
+    NONE,
+    ADD,
+    SUB,    // SUB and CP
+    AND,
+    OR_XOR,
+    INC,    // 8-bit, C unaffected
+    DEC     // 8-bit, C unaffected
+};
+
+// Register pairs overlay their 8-bit halves, so BC/DE/HL/AF are a single
+// 16-bit load or store. The halves are ordered for the host's byte order.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ZB_REG_PAIR(pair, hi, lo) union { u16 pair; struct { u8 hi; u8 lo; }; }
+#else
+#define ZB_REG_PAIR(pair, hi, lo) union { u16 pair; struct { u8 lo; u8 hi; }; }
+#endif
+
+// The last loop closed by a backward jump, and the CPU state the last time
+// the jump landed on its head.
+typedef struct {
+    u16 head;
+    u16 end;                    // one past the closing jump
+    u32 cycles;                 // M-cycles per iteration, 0 if the loop does real work
+    u32 ops;                    // instructions per iteration, closing jump included
+    u64 at;                     // clock when the state below was taken
+    u64 deadline;               // scheduler deadline at that time
+    u16 af, bc, de, hl, sp;
+    u16 timed[2];               // addresses read that only hold for a while (LY, STAT)
+    u8 timed_count;
+} IdleLoop;
+
 class gbRegisters{
 public:
-    u8 a;
-    u8 f;
-    u8 b;
-    u8 c;
-    u8 d;
-    u8 e;
-    u8 h;
-    u8 l;
+    ZB_REG_PAIR(af, a, f);  // f is stale while flag_op is pending, read through get_f()
+    ZB_REG_PAIR(bc, b, c);
+    ZB_REG_PAIR(de, d, e);
+    ZB_REG_PAIR(hl, h, l);
     u16 pc;
     u16 sp;
 
+    // Lazy flags: the last ALU op and its operands. With ZENBOY_LAZY_FLAGS
+    // the flags are only computed when something reads them.
+    FlagOp flag_op = FlagOp::NONE;
+    u8 flag_lhs = 0;
+    u8 flag_rhs = 0;
+    u8 reserved = 0;        // save states copy this class raw; no padding
+    u16 flag_res = 0;
+
     void set_flag(char flag_char, bool value);
     void toggle_flag(bool Z, bool N, bool H, bool C);
     void clear_flag(bool Z,bool N,bool H,bool C);
     bool read_flag(char flag);
     u16 read_reg(RT reg);
     void set_reg(RT reg, uint16_t value);
+    template<RT reg> u16 read_reg();
+    template<RT reg> void set_reg(u16 value);
     std::string Register_by_Name(RT reg);
+
+    void lazy_flags(FlagOp op, u8 lhs, u8 rhs, u16 res);
+    void materialize_flags();
+    u8 get_f();
+    void set_f(u8 value);
+    bool flag_z() const;
+    bool flag_c() const;
 };
 
+inline bool gbRegisters::flag_z() const {
+    return flag_op == FlagOp::NONE ? (f >> 7) & 1 : (flag_res & 0xFF) == 0;
+}
+
+inline bool gbRegisters::flag_c() const {
+    switch (flag_op) {
+        case FlagOp::ADD: return flag_res > 0xFF;
+        case FlagOp::SUB: return flag_lhs < flag_rhs;
+        case FlagOp::AND:
+        case FlagOp::OR_XOR: return false;
+        default: return (f >> 4) & 1;
+    }
+}
+
+inline u8 gbRegisters::get_f() {
+    if (flag_op != FlagOp::NONE) materialize_flags();
+    return f;
+}
+
+inline void gbRegisters::set_f(u8 value) {
+    flag_op = FlagOp::NONE;
+    f = value;
+}
+
+inline void gbRegisters::lazy_flags(FlagOp op, u8 lhs, u8 rhs, u16 res) {
+    if (op == FlagOp::INC || op == FlagOp::DEC) {
+        // C survives INC/DEC: pin the pending op's carry into F first.
+        f = (f & ~0x10) | (flag_c() << 4);
+    }
+    flag_op = op;
+    flag_lhs = lhs;
+    flag_rhs = rhs;
+    flag_res = res;
+#ifndef ZENBOY_LAZY_FLAGS
+    materialize_flags();
+#endif
+}
+
+template<RT reg>
+inline u16 gbRegisters::read_reg() {
+    if constexpr (reg == RT::A) return a;
+    else if constexpr (reg == RT::F) return get_f();
+    else if constexpr (reg == RT::B) return b;
+    else if constexpr (reg == RT::C) return c;
+    else if constexpr (reg == RT::D) return d;
+    else if constexpr (reg == RT::E) return e;
+    else if constexpr (reg == RT::H) return h;
+    else if constexpr (reg == RT::L) return l;
+    else if constexpr (reg == RT::AF) { get_f(); return af; }
+    else if constexpr (reg == RT::BC) return bc;
+    else if constexpr (reg == RT::DE) return de;
+    else if constexpr (reg == RT::HL) return hl;
+    else if constexpr (reg == RT::SP) return sp;
+    else if constexpr (reg == RT::PC) return pc;
+    else return 0;  // RT::NONE
+}
+
+template<RT reg>
+inline void gbRegisters::set_reg(u16 value) {
+    if constexpr (reg == RT::A) a = static_cast<u8>(value);
+    else if constexpr (reg == RT::F) set_f(static_cast<u8>(value));
+    else if constexpr (reg == RT::B) b = static_cast<u8>(value);
+    else if constexpr (reg == RT::C) c = static_cast<u8>(value);
+    else if constexpr (reg == RT::D) d = static_cast<u8>(value);
+    else if constexpr (reg == RT::E) e = static_cast<u8>(value);
+    else if constexpr (reg == RT::H) h = static_cast<u8>(value);
+    else if constexpr (reg == RT::L) l = static_cast<u8>(value);
+    else if constexpr (reg == RT::AF) { flag_op = FlagOp::NONE; af = value; }
+    else if constexpr (reg == RT::BC) bc = value;
+    else if constexpr (reg == RT::DE) de = value;
+    else if constexpr (reg == RT::HL) hl = value;
+    else if constexpr (reg == RT::SP) sp = value;
+    else if constexpr (reg == RT::PC) pc = value;
+}
+
+// Runtime selection for callers that only know the register from the
+// instruction table; each case is the compile-time accessor.
+inline u16 gbRegisters::read_reg(RT reg) {
+    switch (reg) {
+        case RT::A: return read_reg<RT::A>();
+        case RT::F: return read_reg<RT::F>();
+        case RT::B: return read_reg<RT::B>();
+        case RT::C: return read_reg<RT::C>();
+        case RT::D: return read_reg<RT::D>();
+        case RT::E: return read_reg<RT::E>();
+        case RT::H: return read_reg<RT::H>();
+        case RT::L: return read_reg<RT::L>();
+        case RT::AF: return read_reg<RT::AF>();
+        case RT::BC: return read_reg<RT::BC>();
+        case RT::DE: return read_reg<RT::DE>();
+        case RT::HL: return read_reg<RT::HL>();
+        case RT::SP: return read_reg<RT::SP>();
+        case RT::PC: return read_reg<RT::PC>();
+        default: return 0;
+    }
+}
+
+inline void gbRegisters::set_reg(RT reg, uint16_t value) {
+    switch (reg) {
+        case RT::A: set_reg<RT::A>(value); break;
+        case RT::F: set_reg<RT::F>(value); break;
+        case RT::B: set_reg<RT::B>(value); break;
+        case RT::C: set_reg<RT::C>(value); break;
+        case RT::D: set_reg<RT::D>(value); break;
+        case RT::E: set_reg<RT::E>(value); break;
+        case RT::H: set_reg<RT::H>(value); break;
+        case RT::L: set_reg<RT::L>(value); break;
+        case RT::AF: set_reg<RT::AF>(value); break;
+        case RT::BC: set_reg<RT::BC>(value); break;
+        case RT::DE: set_reg<RT::DE>(value); break;
+        case RT::HL: set_reg<RT::HL>(value); break;
+        case RT::SP: set_reg<RT::SP>(value); break;
+        case RT::PC: set_reg<RT::PC>(value); break;
+        default: break;
+    }
+}
+
 class gbCpu{
     public:
-        gbCpu(Bus& bus, Instructions& instr, Timer& timer);
+        gbCpu(Bus& bus, Timer& timer, Scheduler& sched);
         gbRegisters regs;
-        void debug();
-        bool check_cond();
-        void goto_addr(u16 addr, bool pushpc);
+        void debug(std::ostream& out = std::cout);
+        template<CT cond> bool check_cond();
+        template<CT cond> void goto_addr(u16 addr, bool pushpc);
         bool step();
+        bool run(int count);
+        bool is_stopped() const { return stopped; }
+        u64 instructions() const { return retired; }
+        bool quiet_for(u32 span) const;
+        void skip_ops(u16 pc, u32 count);
         void fetch();
-        void decode();
-        void execute();
+        bool fetch_ins();
+        OpHandler fetch_op();
         void set_ie_register(uint8_t value);
         u8 get_ie_register();
         void cpu_handle_interrupts();
         u8 get_int_flags();
         void set_int_flags(u8 value);
         void request_interrupt(interrupt_type t);
-        void dbg_update();
-        void dbg_print();
-        static char dbg_msg[1024];
-        static int msg_size;
+        void set_trace(Trace* trace_ptr);
+
+        size_t state_size() const;
+        void save_state(StateWriter& out) const;
+        void load_state(StateReader& in);
 
     private:
         const InstructionData* curr_ins;
         u16 fetched_data;
         
         Bus& bus;         // Reference to the memory interface
-        Instructions& instr; // Reference to the instructions handler
         Timer& timer;        // Reference to the timer interface
+        Scheduler& sched;    // Clock and peripheral deadlines
+        Trace* trace = nullptr;
 
         u8 opcode;
         u16 mem_dest;
@@ -73,15 +272,64 @@ class gbCpu{
         u8 int_flags = 0;
         bool interupt_en = true;
         bool enabling_ime = false;
-        bool is_mem_dest = false;
         bool halted = false;
+        bool stopped = false;   // hit an invalid opcode; step and run return false
+        u16 imm = 0;
+        u32 cycles = 0;     // M-cycles of the current instruction, added to the clock once it ends
+        u64 retired = 0;    // instructions executed, natively or not, since power on
+
+        IdleLoop idle = {};
+
+        BlockCache blocks;
+        Block* cur_block = nullptr;
+        size_t block_pos = 0;
+        u32 block_gen = 0;
+#ifdef ZENBOY_JIT
+        Jit jit;
+        int run_native(int budget);
+#endif
+        static const std::array<DispatchEntry, 256> dispatch;
+        static const std::array<OpHandler, 256> cb_dispatch;
+
+        // Longest single halted step, one frame, so a CPU with nothing left
+        // to wake it still returns to the run loop.
+        static constexpr u32 HALT_IDLE_CYCLES = FRAME_CYCLES;
+
+        template<TraceLevel l> bool tracing() const { return l <= TRACE_MAX_LEVEL && trace && trace->enabled<l>(); }
+        void trace_instruction() {
+            if (tracing<TraceLevel::INSTRUCTION>()) debug(trace->out());
+        }
+        void update_ime();
+        u32 halted_cycles();
+        u32 idle_skip(u16 head, u16 end, u64 at);
+        u32 idle_loop_cycles(u16 head, u16 end);
+        bool is_idle_op(u16 pc, const InstructionData& ins);
+        bool is_idle_read(u16 address);
+        bool sync_block();
+        Block* build_block(u16 pc, u32 key);
+        template<bool prefetched> u8 read_operand(u16 offset);
+        template<AM mode, RT r1, RT r2, bool prefetched> void decode_mode();
+        template<IN type, AM mode, RT r1, RT r2, CT cond, u8 param> void execute_type();
+        template<u8 op> void proc_cb_op();
+        template<IN type, AM mode, RT r1, RT r2, CT cond, u8 param, bool prefetched>
+        static void op_handler(gbCpu& cpu);
+        template<u8 op> static void cb_handler(gbCpu& cpu);
+        static void op_illegal(gbCpu& cpu);
+        template<u8 op, bool prefetched> static void exec_op(gbCpu& cpu);
+        template<u8 op> static constexpr DispatchEntry make_dispatch_entry();
+        template<std::size_t... I>
+        static constexpr std::array<DispatchEntry, sizeof...(I)> make_dispatch(std::index_sequence<I...>);
+        template<std::size_t... I>
+        static constexpr std::array<OpHandler, sizeof...(I)> make_cb_handlers(std::index_sequence<I...>);
 
         u8 stack_pop();
         u16 stack_pop16();
         void stack_push(u8 data);
         void stack_push16(u16 data);
         void cpu_set_flags(int8_t z, int8_t n, int8_t h, int8_t c);
-        bool is_16_bit(RT reg_type);
+        static constexpr bool is_16_bit(RT reg_type) {
+            return reg_type == RT::AF || reg_type == RT::BC || reg_type == RT::DE || reg_type == RT::HL || reg_type == RT::SP;
+        }
         void int_handle( u16 address);
         bool int_check(u16 address, interrupt_type it);
 
@@ -104,21 +352,21 @@ class gbCpu{
         void proc_cp();
         void proc_di();
         void proc_ei();
-        void proc_ld();
-        void proc_ldh();
-        void proc_jp();
-        void proc_jr();
-        void proc_call();
-        void proc_rst();
-        void proc_ret();
+        template<AM mode, RT r1, RT r2> void proc_ld();
+        template<RT r1> void proc_ldh();
+        template<CT cond> void proc_jp();
+        template<CT cond> void proc_jr();
+        template<CT cond> void proc_call();
+        template<u8 param> void proc_rst();
+        template<CT cond> void proc_ret();
         void proc_reti();
-        void proc_pop();
-        void proc_push();
-        void proc_inc();
-        void proc_dec();
-        void proc_sub();
-        void proc_sbc();
+        template<RT r1> void proc_pop();
+        template<RT r1> void proc_push();
+        template<AM mode, RT r1> void proc_inc();
+        template<AM mode, RT r1> void proc_dec();
+        template<RT r1> void proc_sub();
+        template<RT r1> void proc_sbc();
         void proc_adc();
-        void proc_add();
+        template<RT r1> void proc_add();
     };
 
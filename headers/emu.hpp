@@ -1,6 +1,68 @@
+#pragma once
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+#include "trace.hpp"
+#include "cart.hpp"
+#include "bus.hpp"
+#include "timer.hpp"
+#include "scheduler.hpp"
+#include "cpu.hpp"
+#include "instructions.hpp"
+#include "rewind.hpp"
+
+// Why Emulator::run returned.
+enum class ExitReason : u8 {
+    BUDGET,         // ran for the requested number of cycles
+    PASSED,         // the ROM printed "Passed" over the serial port
+    FAILED,         // the ROM printed "Failed" over the serial port
+    STOPPED,        // the CPU hit an invalid opcode
+    LOAD_FAILED     // no ROM loaded
+};
+
+const char* exit_reason_name(ExitReason reason);
+
+// One emulator instance. Instances share nothing but read-only ROM images,
+// so any number of them can run on different threads.
 class Emulator{
-    
     public:
-        int run_emu(bool debug);
-};
\ No newline at end of file
+        explicit Emulator(TraceLevel trace_level = TraceLevel::SERIAL);
+
+        // Loads the ROM and powers on. Call once per instance.
+        bool load(const std::string& path);
+
+        // Runs until max_cycles M-cycles have passed since power on or the
+        // ROM reports a result.
+        ExitReason run(u64 max_cycles);
+
+        u64 cycles() const { return sched.now(); }
+        u64 instructions() const { return cpu ? cpu->instructions() : 0; }
+        Trace& get_trace() { return trace; }
+        gbCpu* get_cpu() { return cpu.get(); }
+        Bus* get_bus() { return bus.get(); }
+        Scheduler& get_scheduler() { return sched; }
+
+        // Snapshots of the whole instance, see save_state.hpp. load_state
+        // returns false, changing nothing, if the state does not fit.
+        void save_state(std::vector<u8>& out) const;
+        bool load_state(const std::vector<u8>& in);
+
+        // History that run captures into between slices; nullptr turns it
+        // off. step_back restores from it, see Rewind::step_back.
+        void set_rewind(Rewind* history) { rewind = history; }
+        bool step_back(u32 count);
+
+        int run_emu(const std::string& path);
+
+    private:
+        Scheduler sched;
+        Trace trace;
+        Timer timer;
+        Cart cart;
+        std::unique_ptr<Bus> bus;
+        std::unique_ptr<gbCpu> cpu;
+        Rewind* rewind = nullptr;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+
+#include "block_cache.hpp"
+#include "common.hpp"
+
+class gbRegisters;
+
+// x86-64 translator for the register-only prefix of hot basic blocks.
+//
+// Translated code works directly on gbRegisters and never touches the bus or
+// the timer: memory and I/O instructions, and everything after them in the
+// block, stay with the interpreter. The native code returns the M-cycles the
+// translated instructions took (from INSTRUCTION_TABLE) so the caller can
+// catch the timer up in one call at the block boundary.
+//
+// Built only with -DZENBOY_JIT=ON on x86-64 POSIX hosts; elsewhere available()
+// is false and compile() does nothing.
+class Jit {
+    public:
+        typedef u32 (*NativeFn)(gbRegisters* regs);
+
+        static const u32 HOT_THRESHOLD = 8;     // block entries before translating
+        static const u8 MIN_OPS = 2;            // shorter prefixes are not worth a call
+
+        Jit();
+        ~Jit();
+        Jit(const Jit&) = delete;
+        Jit& operator=(const Jit&) = delete;
+
+        bool available() const { return buffer != nullptr; }
+        u32 epoch() const { return code_epoch; }
+
+        // Translates the block's leading register-only ops. Returns false and
+        // leaves block.native null when there is nothing worth translating.
+        bool compile(Block& block);
+
+    private:
+        u8* buffer = nullptr;
+        size_t capacity = 0;
+        size_t used = 0;
+        u32 code_epoch = 1;     // bumped when the code buffer is recycled
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+
+#include "common.hpp"
+
+enum class MbcType : u8 {
+    NONE,   // 32 KiB ROM mapped flat, optional 8 KiB RAM
+    MBC1,
+    MBC3,
+    MBC5
+};
+
+// Memory bank controller registers. Writes to 0x0000-0x7FFF land here; the
+// Bus maps the banks they select straight into its page table, so a switch
+// costs nothing on later reads.
+//
+// The MBC3 clock registers can be selected, latched, read and written but
+// do not tick.
+class Mbc {
+    public:
+        Mbc(MbcType type = MbcType::NONE, u32 rom_banks = 2, u32 ram_banks = 1);
+
+        // Handles a write to 0x0000-0x7FFF. Returns true if the mapping changed.
+        bool write(u16 address, u8 value);
+
+        u32 rom_bank0() const;      // 16 KiB bank at 0x0000-0x3FFF
+        u32 rom_bank() const;       // 16 KiB bank at 0x4000-0x7FFF
+        u32 ram_bank() const;       // 8 KiB bank at 0xA000-0xBFFF
+        bool ram_mapped() const;    // a RAM bank is enabled and selected
+
+        bool rtc_mapped() const;    // an MBC3 clock register is enabled and selected
+        u8 rtc_read() const;
+        void rtc_write(u8 value);
+
+    private:
+        // Saved as raw bytes by the Bus: ordered so there is no padding,
+        // which would differ between otherwise identical states.
+        u32 rom_banks;
+        u32 ram_banks;
+        MbcType type;
+
+        bool ram_enable = false;
+        u16 rom_select = 1;         // MBC1: 5 bits, MBC3: 7 bits, MBC5: 9 bits
+        u8 ram_select = 0;          // MBC1: 2 bits, also ROM bits 5-6; MBC3: bank or clock register
+        bool mbc1_mode = false;     // MBC1: the 2-bit register also banks 0x0000 and RAM
+
+        u8 rtc[5] = {};             // seconds, minutes, hours, day low, day high/flags
+        u8 rtc_latched[5] = {};
+        u8 latch_prev = 0xFF;
+        u8 reserved[3] = {};
+};
+
+MbcType mbc_type_for(u8 cart_type);
+size_t cart_ram_size(u8 ram_size_code);
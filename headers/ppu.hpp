@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+
+#include "common.hpp"
+#include "renderer.hpp"
+
+class gbCpu;
+class Scheduler;
+class StateWriter;
+class StateReader;
+
+// M-cycles of each part of a line. Lines 144 to 153 are VBlank, a whole
+// line each.
+const u32 OAM_SCAN_CYCLES = 20;
+const u32 TRANSFER_CYCLES = 43;
+const u32 HBLANK_CYCLES = 51;
+const u32 LINE_CYCLES = 114;
+const u8 VBLANK_LINE = 144;
+const u8 LINES_PER_FRAME = 154;
+
+// STAT mode bits.
+enum PpuMode : u8 {
+    MODE_HBLANK = 0,
+    MODE_VBLANK = 1,
+    MODE_OAM_SCAN = 2,
+    MODE_TRANSFER = 3
+};
+
+// The LCD controller. It owns VRAM and OAM. LY, the mode and the LYC flag
+// are worked out from the clock when read, counting from the cycle the LCD
+// was turned on; the only events are VBlank once a frame and the next
+// rising edge of the STAT interrupt, when one is enabled. Lines are drawn
+// in one go as if when their transfer mode ended, caught up before anything
+// that changes the picture is written; the drawing is left to a Renderer,
+// which can run on its own thread.
+class Ppu {
+    public:
+        Ppu();
+
+        void set_cpu(gbCpu* cpu_ptr);
+        void set_scheduler(Scheduler* sched_ptr);
+
+        // The Bus maps VRAM pages straight to this for reads; writes go
+        // through vram_write so the renderer sees them.
+        u8* vram_data() { return vram; }
+        void vram_write(u16 offset, u8 value);
+        u8 oam_read(u8 index) const { return oam[index]; }
+        void oam_write(u8 index, u8 value);
+
+        // LCD registers, 0xFF40 to 0xFF4B. The Bus does the OAM DMA copy.
+        u8 read(u16 address) const;
+        void write(u16 address, u8 value);
+
+        // Draws on a worker thread, a few lines behind the CPU.
+        void set_threaded(bool on) { renderer.set_threaded(on); }
+
+        // Draws one frame out of every `frames`, the first of each group;
+        // 0 draws nothing and keeps only the timing. A change takes effect
+        // from the next frame. Use Bus::set_render_interval, which also
+        // remaps VRAM.
+        void set_render_interval(u32 frames);
+        u32 render_interval() const { return interval; }
+
+        // LCD_WIDTH x LCD_HEIGHT shades, 0 (white) to 3 (black), as drawn
+        // so far. Waits for a rendering thread to catch up.
+        const u8* framebuffer();
+        // Frames completed, counted at the start of VBlank.
+        u64 frames() const { return frame_count; }
+
+        // First cycle after `from` at which reading address (LY or STAT)
+        // may give a different value with no write in between, or
+        // Scheduler::NEVER.
+        u64 stable_until(u16 address, u64 from) const;
+
+        size_t state_size() const;
+        void save_state(StateWriter& out) const;
+        void load_state(StateReader& in);
+
+    private:
+        gbCpu* cpu = nullptr;
+        Scheduler* sched = nullptr;
+
+        u8 vram[0x2000];
+        u8 oam[0xA0];
+        // Flushed by save_state, which is const.
+        mutable Renderer renderer;
+
+        u8 lcdc = 0x91;
+        u8 stat = 0x00;         // interrupt enables only; mode and LYC flag are computed
+        u8 scy = 0;
+        u8 scx = 0;
+        u8 lyc = 0;
+        u8 dma = 0xFF;
+        u8 bgp = 0xFC;
+        u8 obp0 = 0xFF;
+        u8 obp1 = 0xFF;
+        u8 wy = 0;
+        u8 wx = 0;
+
+        u32 interval = 1;
+        bool drawing = true;    // this frame is drawn
+
+        u64 origin = 0;         // cycle the LCD was turned on, at line 0
+        u64 next_draw = 0;      // end of the transfer mode of the next line to draw
+        u64 frame_count = 0;
+
+        u64 now() const;
+        void position(u64 at, u8& line, u8& mode) const;
+        bool stat_high(u64 at) const;
+        u64 next_change(u64 from, bool lines_only) const;
+        u64 first_draw_after(u64 at) const;
+        void catch_up(u64 at);
+        void reset_renderer(u8 window);
+        void forward(u16 address, u8 value);
+        void turn_on(u64 at);
+        void stat_changed(bool was_high);
+        void schedule_stat(u64 from);
+        static void on_vblank(void* ctx, u64 when);
+        static void on_stat(void* ctx, u64 when);
+};
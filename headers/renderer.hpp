@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "common.hpp"
+
+const int LCD_WIDTH = 160;
+const int LCD_HEIGHT = 144;
+
+// Tiles in VRAM, 16 bytes each, before the tile maps at 0x9800.
+const int TILE_COUNT = 384;
+
+// Draws the picture for the PPU. It keeps its own copy of VRAM, OAM and the
+// LCD registers that affect pixels, updated from the writes the PPU passes
+// on in order, with markers for where each line is drawn and where a frame
+// starts. Timing (LY, STAT, interrupts) stays with the PPU.
+//
+// Normally everything is applied at once on the emulation thread. Threaded,
+// the writes go into a single-producer single-consumer log and a worker
+// thread replays them, so lines are drawn a little behind the CPU on
+// another core.
+class Renderer {
+    public:
+        Renderer();
+        ~Renderer();
+        Renderer(const Renderer&) = delete;
+        Renderer& operator=(const Renderer&) = delete;
+
+        void set_threaded(bool on);
+        bool threaded() const { return worker.joinable(); }
+
+        // Emulation thread only, in emulation order.
+        void write(u16 address, u8 value);      // VRAM, OAM or 0xFF40-0xFF4B
+        void draw_line(u8 line);
+        void start_frame();
+
+        // Waits until everything logged has been applied. Until the next
+        // write the renderer's state may then be read or replaced.
+        void flush();
+
+        // LCD_WIDTH x LCD_HEIGHT shades, 0 (white) to 3 (black). Call flush
+        // first when threaded.
+        const u8* framebuffer() const { return frame; }
+
+        // Replaces the copy of the PPU's state, after a save state load.
+        // lcd_regs holds 0xFF40-0xFF4B. Flushes first.
+        void reset(const u8* vram_src, const u8* oam_src, const u8* lcd_regs, u8 window);
+        // Window rows drawn this frame. Call flush first when threaded.
+        u8 window_row() const { return window_line; }
+
+    private:
+        enum EntryKind : u8 {
+            ENTRY_WRITE,
+            ENTRY_LINE,         // draw line `value`
+            ENTRY_FRAME         // a new frame starts
+        };
+
+        typedef struct {
+            u16 address;
+            u8 value;
+            u8 kind;
+        } Entry;
+
+        // Entries in the log; the producer waits when it is full.
+        static constexpr size_t LOG_SIZE = 1 << 14;
+        // Writes logged before they are published to the worker; lines and
+        // frames are published at once.
+        static constexpr size_t PUBLISH_EVERY = 256;
+
+        u8 vram[0x2000];
+        u8 oam[0xA0];
+        u8 frame[LCD_WIDTH * LCD_HEIGHT];
+        u8 lcdc = 0x91;
+        u8 scy = 0;
+        u8 scx = 0;
+        u8 bgp = 0xFC;
+        u8 obp0 = 0xFF;
+        u8 obp1 = 0xFF;
+        u8 wy = 0;
+        u8 wx = 0;
+        u8 window_line = 0;     // window rows drawn this frame
+
+        // The tiles in VRAM decoded to one colour index per pixel, row by
+        // row. A tile is decoded again only after one of its bytes was
+        // written.
+        u8 tiles[TILE_COUNT][64];
+        bool tile_stale[TILE_COUNT];
+
+        std::unique_ptr<Entry[]> log;
+        size_t produced = 0;                // emulation thread's next slot
+        std::atomic<size_t> head{0};        // published by the emulation thread
+        std::atomic<size_t> tail{0};        // applied by the worker
+        std::atomic<bool> running{false};
+        std::thread worker;
+
+        void push(Entry entry, bool now);
+        void publish();
+        void apply(const Entry& entry);
+        void work();
+
+        const u8* tile(u16 index);
+        const u8* tile_row(u8 index, u8 row);
+        void draw_tiles(u8* out, int x, u16 map, u8 y, u8 scroll);
+        void draw_sprites(u8 line, const u8* bg, u8* out);
+        void render_line(u8 line);
+};
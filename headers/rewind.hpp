@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include "common.hpp"
+
+class gbCpu;
+class Bus;
+class Timer;
+class Scheduler;
+
+// History of save states for stepping an instance back in time.
+//
+// A state is captured every interval_frames frames. Each capture is stored
+// as the XOR of it and the previous capture with runs of zero words
+// squeezed out, so the cost per capture is roughly the number of words that
+// changed. Every keyframe_every captures the state is stored against zero
+// instead, which bounds how many deltas a step back has to apply. When the
+// history outgrows max_bytes the oldest keyframe and its deltas are dropped;
+// the newest capture is always kept, so a budget smaller than one state
+// still holds that one.
+class Rewind {
+    public:
+        Rewind(u32 interval_frames = 1, u32 keyframe_every = 60, size_t max_bytes = 4 << 20);
+
+        // Captures a state once interval_frames frames have passed since the
+        // last capture.
+        void update(const gbCpu& cpu, const Bus& bus, const Timer& timer, const Scheduler& sched);
+        void capture(const gbCpu& cpu, const Bus& bus, const Timer& timer, const Scheduler& sched);
+
+        // Restores the state captured count captures before the newest one,
+        // or the oldest kept, and forgets everything newer. Returns false if
+        // nothing has been captured.
+        bool step_back(u32 count, gbCpu& cpu, Bus& bus, Timer& timer, Scheduler& sched);
+
+        size_t captures() const { return entries.size(); }
+        size_t memory_used() const { return used; }
+        void clear();
+
+    private:
+        typedef struct {
+            std::vector<u64> delta;     // encoded against the previous capture, or zero
+            bool keyframe;
+        } Entry;
+
+        u64 interval;
+        u32 keyframe_every;
+        size_t max_bytes;
+
+        std::deque<Entry> entries;
+        size_t used = 0;
+        u32 since_keyframe = 0;
+        u64 next_capture = 0;
+
+        size_t state_bytes = 0;
+        std::vector<u8> newest;     // newest capture, padded to whole words
+        std::vector<u8> scratch;
+        std::vector<u8> zero;
+
+        void restore(std::vector<u8>& state, gbCpu& cpu, Bus& bus, Timer& timer, Scheduler& sched);
+        bool evict();
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+
+// Read-only ROM contents, shared by every Cart in the process that loads the
+// same file. Where mmap is available the file is mapped rather than read, so
+// instances running the same ROM share its pages instead of holding a copy
+// each. The image is unmapped when the last Cart or Bus using it goes away.
+class RomImage {
+    public:
+        // nullptr if the file cannot be read.
+        static std::shared_ptr<const RomImage> open(const std::string& path);
+
+        RomImage(const RomImage&) = delete;
+        RomImage& operator=(const RomImage&) = delete;
+        ~RomImage();
+
+        const u8* data() const { return bytes; }
+        size_t size() const { return length; }  // whole 16 KiB banks, at least two
+        // FNV-1a of the contents, so save states can tell which ROM they
+        // belong to.
+        u32 hash() const { return checksum; }
+
+    private:
+        RomImage() = default;
+
+        const u8* bytes = nullptr;
+        size_t length = 0;
+        u32 checksum = 0;
+        void* mapping = nullptr;    // mmap'd file, or nullptr if the ROM was copied
+        std::vector<u8> copy;       // ROMs that had to be padded, or without mmap
+};
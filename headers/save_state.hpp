@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "common.hpp"
+
+class gbCpu;
+class Bus;
+class Timer;
+class Scheduler;
+
+// Save states are a SaveStateHeader followed by the CPU, timer, scheduler
+// and bus sections in that order. Each section is a few raw copies of the
+// component's plain-data state, so the layout is only valid for the same
+// version and host byte order. Those types must not have padding, so two
+// identical instances give the same bytes. Bump SAVE_STATE_VERSION whenever a section
+// changes or one is added (APU).
+const u32 SAVE_STATE_MAGIC = 0x5453425A;   // "ZBST"
+const u16 SAVE_STATE_VERSION = 4;
+
+typedef struct {
+    u32 magic;
+    u16 version;
+    u16 endian;         // 0x0102 as written by the host
+    u32 size;           // whole state, header included
+    u32 cart_ram_size;
+    u32 rom_size;       // the ROM the state was taken from
+    u32 rom_hash;
+} SaveStateHeader;
+
+class StateWriter {
+    public:
+        explicit StateWriter(std::vector<u8>& out) : out(out) {}
+
+        void bytes(const void* data, size_t size) {
+            size_t at = out.size();
+            out.resize(at + size);
+            std::memcpy(out.data() + at, data, size);
+        }
+        template<typename T> void pod(const T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "save states copy raw bytes");
+            static_assert(std::has_unique_object_representations<T>::value, "padding would be saved uninitialised");
+            bytes(&value, sizeof(T));
+        }
+
+    private:
+        std::vector<u8>& out;
+};
+
+class StateReader {
+    public:
+        StateReader(const u8* data, size_t size) : cur(data), end(data + size) {}
+
+        // False once a read ran past the end; the target is left unchanged.
+        bool bytes(void* data, size_t size) {
+            if (static_cast<size_t>(end - cur) < size) {
+                ok = false;
+                return false;
+            }
+            std::memcpy(data, cur, size);
+            cur += size;
+            return true;
+        }
+        template<typename T> bool pod(T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "save states copy raw bytes");
+            return bytes(&value, sizeof(T));
+        }
+        bool good() const { return ok; }
+
+    private:
+        const u8* cur;
+        const u8* end;
+        bool ok = true;
+};
+
+// Replaces out with a snapshot of one emulator instance.
+void save_state(const gbCpu& cpu, const Bus& bus, const Timer& timer, const Scheduler& sched,
+                std::vector<u8>& out);
+// Restores a snapshot taken from an instance running the same ROM. Returns
+// false, leaving the instance untouched, if it does not fit or was taken
+// from another ROM.
+bool load_state(gbCpu& cpu, Bus& bus, Timer& timer, Scheduler& sched, const std::vector<u8>& in);
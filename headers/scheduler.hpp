@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "common.hpp"
+#include "save_state.hpp"
+
+// Things that happen at a known future cycle. Each type has at most one
+// pending deadline; scheduling it again replaces the previous one.
+enum class EventType : u8 {
+    TIMER_OVERFLOW,     // TIMA wraps and reloads from TMA
+    SERIAL_DONE,        // the 8th bit of a serial transfer is shifted out
+    PPU_VBLANK,         // the PPU reaches line 144
+    PPU_STAT,           // the PPU's STAT interrupt line rises
+    COUNT
+};
+
+typedef void (*EventHandler)(void* ctx, u64 when);
+
+// Cycle-timestamped event queue. The clock counts M-cycles since power on;
+// the CPU advances it after every instruction and the scheduler calls the
+// handler of every event whose deadline has been reached, so peripherals do
+// work per event instead of per cycle.
+//
+// The queue is a binary min-heap. Replaced or cancelled deadlines stay in the
+// heap and are dropped when they reach the top.
+class Scheduler {
+    public:
+        static constexpr u64 NEVER = UINT64_MAX;
+
+        typedef struct {
+            u64 when;
+            EventType type;
+        } Event;
+
+        Scheduler();
+
+        u64 now() const { return cycle; }
+        u64 next_deadline() const { return next; }
+        u64 deadline(EventType type) const { return deadlines[static_cast<size_t>(type)]; }
+
+        void set_handler(EventType type, EventHandler handler, void* ctx);
+        void schedule(EventType type, u64 when);
+        void cancel(EventType type);
+
+        size_t state_size() const;
+        void save_state(StateWriter& out) const;
+        void load_state(StateReader& in);
+
+        // Moves the clock forward and runs the events that are now due.
+        void advance(u32 cycles) {
+            cycle += cycles;
+            if (cycle >= next) {
+                run_due();
+            }
+        }
+
+    private:
+        static constexpr size_t MAX_HEAP = 64;
+
+        u64 cycle = 0;
+        u64 next = NEVER;       // earliest live deadline
+        std::vector<Event> heap;
+        u64 deadlines[static_cast<size_t>(EventType::COUNT)];
+        EventHandler handlers[static_cast<size_t>(EventType::COUNT)];
+        void* contexts[static_cast<size_t>(EventType::COUNT)];
+
+        void run_due();
+        void update_next();
+        void compact();
+};
@@ -20,32 +20,56 @@
 // };
 
 #pragma once
+#include <cstddef>
 #include <cstdint>
 
 using u8  = uint8_t;
 using u16 = uint16_t;
+using u32 = uint32_t;
 
 class gbCpu; // forward declaration
+class Scheduler;
+class StateWriter;
+class StateReader;
 
 class Timer {
 public:
     Timer(gbCpu* cpu_ptr = nullptr) : cpu(cpu_ptr) {}
 
     void set_cpu(gbCpu* cpu_ptr);
-    void emu_cycles(int cycles);
+    void set_scheduler(Scheduler* sched_ptr);
     void timer_init();
 
     void timer_write(u16 address, u8 value);
     u8   timer_read(u16 address);
 
+    u16  div_counter() const;           // full 16-bit divider, DIV is the high byte
+    void set_div_counter(u16 value);
+    u32  cycles_until_overflow() const;
+
+    size_t state_size() const;
+    void save_state(StateWriter& out) const;
+    void load_state(StateReader& in);
+
     gbCpu* cpu = nullptr;
+    Scheduler* sched = nullptr;
 
-    u16 div = 0;
     u8  tima = 0;
     u8  tma  = 0;
     u8  tac  = 0;
 
-    void timer_tick();
-    void timer_step();      // TIMA increment + overflow handling
+private:
+    // The divider is not stored: it is the number of T-cycles since
+    // div_origin. TIMA is current up to the divider value tima_counter and
+    // is brought forward by counting falling edges of the selected bit.
+    uint64_t div_origin = 0;
+    uint64_t tima_counter = 0;
+
+    uint64_t now_ticks() const;
+    uint64_t counter() const;
+    void sync();
+    void add_tima(uint64_t edges);
+    void schedule_overflow();
+    static void on_overflow(void* ctx, uint64_t when);
     int  timer_bit() const; // which DIV bit is used based on TAC
 };
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+
+#include "common.hpp"
+
+// What the emulator reports while it runs. Each level includes the ones
+// below it.
+enum class TraceLevel : u8 {
+    OFF,
+    SERIAL,         // bytes sent over the serial port, a line at a time
+    INSTRUCTION     // CPU state before every instruction
+};
+
+// Highest level compiled in; checks for the levels above it fold away.
+#ifndef ZENBOY_TRACE_LEVEL
+#define ZENBOY_TRACE_LEVEL 1
+#endif
+constexpr TraceLevel TRACE_MAX_LEVEL = static_cast<TraceLevel>(ZENBOY_TRACE_LEVEL);
+
+bool parse_trace_level(const char* name, TraceLevel& level);
+
+// Trace output of one emulator instance, written to std::cerr unless
+// redirected. What a test ROM printed is kept by the Bus whatever the level
+// (Bus::serial_text).
+class Trace {
+    public:
+        explicit Trace(TraceLevel level = TraceLevel::SERIAL);
+        ~Trace();
+
+        void set_level(TraceLevel new_level) { level = new_level; }
+        void set_output(std::ostream* stream) { output = stream; }
+        template<TraceLevel l> bool enabled() const { return l <= TRACE_MAX_LEVEL && l <= level; }
+
+        void serial(u8 byte);
+        std::ostream& out();
+
+    private:
+        TraceLevel level;
+        std::ostream* output = nullptr;
+        std::string serial_line;
+
+        void flush_serial();
+};
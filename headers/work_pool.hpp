@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+typedef void (*PoolJob)(void* ctx, size_t index);
+
+// Runs a batch of independent jobs on a fixed number of threads. Each worker
+// has its own queue and takes jobs from its back; a worker whose queue is
+// empty steals from the front of another's, so one slow job does not leave
+// the jobs queued behind it waiting.
+class WorkPool {
+    public:
+        // threads == 0 uses one thread per hardware thread.
+        explicit WorkPool(unsigned threads = 0);
+
+        unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+        // Calls job(ctx, i) once for every i below count and returns once
+        // all of them have finished.
+        void run(size_t count, PoolJob job, void* ctx);
+
+    private:
+        typedef struct {
+            std::mutex lock;
+            std::deque<size_t> jobs;
+        } Queue;
+
+        std::vector<std::unique_ptr<Queue>> queues;
+
+        bool take(unsigned worker, size_t& index);
+        void work(unsigned worker, PoolJob job, void* ctx);
+};
@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <cstring>
+
+#include "../headers/batch.hpp"
+#include "../headers/block_cache.hpp"
+
+// Sort key of lanes that cannot take part in a lockstep run.
+static const u64 NO_RUN = 0xFFFFFFFFull;
+
+// Register-only instructions that run in lockstep; the JIT's set without
+// its branches, which are left to the lanes so idle loops are still seen.
+static bool lockstep_op(const InstructionData& ins) {
+    auto reg8 = [](RT reg) {
+        return reg == RT::A || reg == RT::B || reg == RT::C || reg == RT::D ||
+               reg == RT::E || reg == RT::H || reg == RT::L;
+    };
+    auto pair = [](RT reg) { return reg == RT::BC || reg == RT::DE || reg == RT::HL || reg == RT::SP; };
+    switch (ins.type) {
+        case IN::NOP:
+        case IN::CPL:
+        case IN::SCF:
+        case IN::CCF:
+            return true;
+        case IN::LD:
+            if (ins.mode == AM::R_R) {
+                return (reg8(ins.reg_1) && reg8(ins.reg_2)) || (ins.reg_1 == RT::SP && ins.reg_2 == RT::HL);
+            }
+            if (ins.mode == AM::R_D8) return reg8(ins.reg_1);
+            if (ins.mode == AM::R_D16) return pair(ins.reg_1);
+            return false;
+        case IN::INC:
+        case IN::DEC:
+            return ins.mode == AM::R && (reg8(ins.reg_1) || pair(ins.reg_1));
+        case IN::ADD:
+        case IN::SUB:
+        case IN::AND:
+        case IN::XOR:
+        case IN::OR:
+        case IN::CP:
+            if (ins.reg_1 != RT::A) return false;
+            return ins.mode == AM::R_D8 || (ins.mode == AM::R_R && reg8(ins.reg_2));
+        default:
+            return false;
+    }
+}
+
+static u8 op_length(const InstructionData& ins) {
+    if (ins.mode == AM::R_D8) return 2;
+    if (ins.mode == AM::R_D16) return 3;
+    return 1;
+}
+
+Batch::Batch(const std::string& rom_path, size_t count, TraceLevel trace_level) {
+    for (size_t i = 0; i < count; i++) {
+        lanes.push_back(std::make_unique<Emulator>(trace_level));
+        ok = ok && lanes.back()->load(rom_path);
+        cpus.push_back(lanes.back()->get_cpu());
+        buses.push_back(lanes.back()->get_bus());
+        scheds.push_back(&lanes.back()->get_scheduler());
+    }
+    recent.assign(RECENT_RUNS, nullptr);
+}
+
+u64 Batch::instructions() const {
+    u64 total = 0;
+    for (const std::unique_ptr<Emulator>& lane : lanes) {
+        total += lane->instructions();
+    }
+    return total;
+}
+
+// Where a lane's next run would be cached, NO_RUN outside ROM.
+u64 Batch::lane_key(u32 lane) const {
+    u16 pc = cpus[lane]->regs.pc;
+    return pc < 0x8000 ? BlockCache::key(pc, buses[lane]->rom_bank_at(pc)) : NO_RUN;
+}
+
+// Decodes the register-only instructions at pc, staying inside the 16 KiB
+// ROM region pc is in so the bank in the key covers all of them.
+const Batch::Run& Batch::run_at(Bus& bus, u16 pc, u32 key) {
+    const Run*& slot = recent[(key ^ (key >> 12)) % RECENT_RUNS];
+    if (slot != nullptr && slot->key == key) {
+        return *slot;
+    }
+    auto it = runs.find(key);
+    if (it == runs.end()) {
+        Run run = {};
+        run.key = key;
+        u32 limit = pc < 0x4000 ? 0x4000 : 0x8000;
+        u32 addr = pc;
+        while (run.ops.size() < MAX_RUN_OPS && addr < limit) {
+            const InstructionData& ins = INSTRUCTION_TABLE[bus.read(addr)];
+            u8 length = op_length(ins);
+            if (!lockstep_op(ins) || addr + length > limit) break;
+            u16 imm = 0;
+            if (length > 1) imm = bus.read(addr + 1);
+            if (length > 2) imm |= bus.read(addr + 2) << 8;
+            run.ops.push_back(RunOp{&ins, imm});
+            run.cycles += ins.cycles;
+            addr += length;
+        }
+        run.end = static_cast<u16>(addr);
+        it = runs.emplace(key, std::move(run)).first;
+    }
+    slot = &it->second;
+    return it->second;
+}
+
+void Batch::run_frames(u32 frames) {
+    if (!ok) {
+        return;
+    }
+    size_t count = lanes.size();
+    targets.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        targets[i] = scheds[i]->now() + static_cast<u64>(frames) * FRAME_CYCLES;
+    }
+    for (size_t begin = 0; begin < count; begin += TILE_LANES) {
+        run_tile(static_cast<u32>(begin), static_cast<u32>(std::min(count, begin + TILE_LANES)));
+    }
+}
+
+// Each round moves every unfinished lane of the tile on by one lockstep run
+// or a stretch of solo instructions. Lanes at the same ROM address and bank
+// sort together.
+void Batch::run_tile(u32 begin, u32 end) {
+    for (;;) {
+        keys.clear();
+        for (u32 i = begin; i < end; i++) {
+            if (cpus[i]->is_stopped() || scheds[i]->now() >= targets[i]) continue;
+            keys.push_back(lane_key(i) << 32 | i);
+        }
+        if (keys.empty()) {
+            break;
+        }
+        // Lanes that started alike mostly stay together; only sort once
+        // they have drifted apart.
+        u64 lead = keys[0] >> 32;
+        if (std::any_of(keys.begin(), keys.end(), [lead](u64 k) { return k >> 32 != lead; })) {
+            std::sort(keys.begin(), keys.end());
+        }
+
+        for (size_t first = 0; first < keys.size();) {
+            u64 key = keys[first] >> 32;
+            size_t last = first + 1;
+            while (last < keys.size() && keys[last] >> 32 == key) last++;
+
+            const Run* run = nullptr;
+            if (key != NO_RUN && last - first >= MIN_RUN_LANES) {
+                u32 lane = static_cast<u32>(keys[first]);
+                run = &run_at(*buses[lane], cpus[lane]->regs.pc, static_cast<u32>(key));
+            }
+            if (run == nullptr || run->ops.size() < MIN_RUN_OPS) {
+                for (size_t k = first; k < last; k++) run_solo(static_cast<u32>(keys[k]));
+                first = last;
+                continue;
+            }
+
+            group.clear();
+            for (size_t k = first; k < last; k++) {
+                u32 lane = static_cast<u32>(keys[k]);
+                if (cpus[lane]->quiet_for(run->cycles) && scheds[lane]->now() + run->cycles < targets[lane]) {
+                    group.push_back(lane);
+                } else {
+                    cpus[lane]->step();
+                }
+            }
+            if (group.size() >= MIN_RUN_LANES) {
+                // A run ends at an instruction that cannot join one; carry
+                // each lane through it to where the next run could start.
+                step_group(*run, group.data(), group.size());
+                for (u32 lane : group) {
+                    if (scheds[lane]->now() < targets[lane]) run_solo(lane);
+                }
+            } else {
+                for (u32 lane : group) cpus[lane]->step();
+            }
+            first = last;
+        }
+    }
+}
+
+// Runs a lane on its own until it reaches code that could run in lockstep,
+// its frame ends or MAX_SOLO_STEPS instructions have passed. Runs are only
+// looked for where control flow lands, which is where they usually start.
+void Batch::run_solo(u32 lane) {
+    gbCpu& cpu = *cpus[lane];
+    for (u32 n = 0; n < MAX_SOLO_STEPS; n++) {
+        u16 pc = cpu.regs.pc;
+        if (!cpu.step() || scheds[lane]->now() >= targets[lane]) {
+            return;
+        }
+        if (static_cast<u16>(cpu.regs.pc - pc) <= 3) {
+            continue;
+        }
+        u64 key = lane_key(lane);
+        if (key != NO_RUN && run_at(*buses[lane], cpu.regs.pc, static_cast<u32>(key)).ops.size() >= MIN_RUN_OPS) {
+            return;
+        }
+    }
+}
+
+// Copies the group's registers into the arrays, runs the ops over all of
+// them and copies them back.
+void Batch::step_group(const Run& run, const u32* members, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        gbRegisters& regs = cpus[members[i]]->regs;
+        soa.a[i] = regs.a;
+        soa.f[i] = regs.get_f();
+        soa.b[i] = regs.b;
+        soa.c[i] = regs.c;
+        soa.d[i] = regs.d;
+        soa.e[i] = regs.e;
+        soa.h[i] = regs.h;
+        soa.l[i] = regs.l;
+        soa.sp[i] = regs.sp;
+    }
+
+    for (const RunOp& op : run.ops) {
+        execute(op);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        gbCpu& cpu = *cpus[members[i]];
+        gbRegisters& regs = cpu.regs;
+        regs.a = soa.a[i];
+        regs.set_f(soa.f[i]);
+        regs.b = soa.b[i];
+        regs.c = soa.c[i];
+        regs.d = soa.d[i];
+        regs.e = soa.e[i];
+        regs.h = soa.h[i];
+        regs.l = soa.l[i];
+        regs.sp = soa.sp[i];
+        cpu.skip_ops(run.end, static_cast<u32>(run.ops.size()));
+        scheds[members[i]]->advance(run.cycles);
+    }
+    lockstep += run.ops.size() * count;
+}
+
+u8* Batch::reg8(RT reg) {
+    switch (reg) {
+        case RT::A: return soa.a;
+        case RT::B: return soa.b;
+        case RT::C: return soa.c;
+        case RT::D: return soa.d;
+        case RT::E: return soa.e;
+        case RT::H: return soa.h;
+        default: return soa.l;
+    }
+}
+
+// Loops over a whole tile of lanes. The operands are copied into locals
+// first so the compiler can see that nothing aliases and vectorize each
+// loop even at its cheapest cost model.
+static const size_t LANES = Batch::TILE_LANES;
+
+// dst = op(src) lane by lane.
+template<typename Op>
+static void map_lanes(u8* dst, const u8* src, Op op) {
+    u8 in[LANES], out[LANES];
+    std::memcpy(in, src, LANES);
+    for (size_t i = 0; i < LANES; i++) out[i] = op(in[i]);
+    std::memcpy(dst, out, LANES);
+}
+
+// acc = op(acc, src) and F = flags(acc, src, result, F) lane by lane; CP
+// only sets F.
+template<typename Op, typename Flags>
+static void alu_lanes(u8* acc, const u8* src, u8* fl, bool store, Op op, Flags flags) {
+    u8 x[LANES], y[LANES], f[LANES], r[LANES];
+    std::memcpy(x, acc, LANES);
+    std::memcpy(y, src, LANES);
+    std::memcpy(f, fl, LANES);
+    for (size_t i = 0; i < LANES; i++) {
+        r[i] = op(x[i], y[i]);
+        f[i] = flags(x[i], y[i], r[i], f[i]);
+    }
+    if (store) std::memcpy(acc, r, LANES);
+    std::memcpy(fl, f, LANES);
+}
+
+// Adds delta to the register pair held in hi and lo.
+static void add_pair(u8* hi, u8* lo, u16 delta) {
+    u8 h[LANES], l[LANES];
+    std::memcpy(h, hi, LANES);
+    std::memcpy(l, lo, LANES);
+    for (size_t i = 0; i < LANES; i++) {
+        u16 v = static_cast<u16>((h[i] << 8 | l[i]) + delta);
+        h[i] = static_cast<u8>(v >> 8);
+        l[i] = static_cast<u8>(v);
+    }
+    std::memcpy(hi, h, LANES);
+    std::memcpy(lo, l, LANES);
+}
+
+// One instruction for every lane. Flags are computed eagerly, as
+// gbRegisters::materialize_flags would; the low nibble of F is kept.
+void Batch::execute(const RunOp& op) {
+    const InstructionData& ins = *op.ins;
+    u8 imm8 = op.imm & 0xFF;
+
+    switch (ins.type) {
+        case IN::NOP:
+            return;
+        case IN::CPL:
+            map_lanes(soa.a, soa.a, [](u8 x) { return static_cast<u8>(~x); });
+            map_lanes(soa.f, soa.f, [](u8 x) { return static_cast<u8>(x | 0x60); });
+            return;
+        case IN::SCF:
+            map_lanes(soa.f, soa.f, [](u8 x) { return static_cast<u8>((x & 0x8F) | 0x10); });
+            return;
+        case IN::CCF:
+            map_lanes(soa.f, soa.f, [](u8 x) { return static_cast<u8>((x ^ 0x10) & 0x9F); });
+            return;
+        default:
+            break;
+    }
+
+    bool pair = ins.reg_1 == RT::BC || ins.reg_1 == RT::DE || ins.reg_1 == RT::HL;
+    u8* hi = ins.reg_1 == RT::BC ? soa.b : ins.reg_1 == RT::DE ? soa.d : soa.h;
+    u8* lo = ins.reg_1 == RT::BC ? soa.c : ins.reg_1 == RT::DE ? soa.e : soa.l;
+
+    if (ins.type == IN::LD) {
+        if (ins.reg_1 == RT::SP && ins.mode == AM::R_R) {
+            for (size_t i = 0; i < LANES; i++) soa.sp[i] = static_cast<u16>(soa.h[i] << 8 | soa.l[i]);
+        } else if (ins.reg_1 == RT::SP) {
+            for (size_t i = 0; i < LANES; i++) soa.sp[i] = op.imm;
+        } else if (pair) {
+            std::memset(hi, op.imm >> 8, LANES);
+            std::memset(lo, op.imm & 0xFF, LANES);
+        } else if (ins.mode == AM::R_D8) {
+            std::memset(reg8(ins.reg_1), imm8, LANES);
+        } else {
+            std::memmove(reg8(ins.reg_1), reg8(ins.reg_2), LANES);
+        }
+        return;
+    }
+
+    if (ins.type == IN::INC || ins.type == IN::DEC) {
+        bool inc = ins.type == IN::INC;
+        if (ins.reg_1 == RT::SP) {
+            for (size_t i = 0; i < LANES; i++) soa.sp[i] = static_cast<u16>(soa.sp[i] + (inc ? 1 : -1));
+        } else if (pair) {
+            add_pair(hi, lo, inc ? 1 : 0xFFFF);
+        } else if (inc) {
+            u8* r = reg8(ins.reg_1);
+            alu_lanes(r, r, soa.f, true, [](u8 x, u8) { return static_cast<u8>(x + 1); },
+                      [](u8, u8, u8 v, u8 f) {
+                          return static_cast<u8>((f & 0x1F) | (v == 0 ? 0x80 : 0) | ((v & 0xF) == 0 ? 0x20 : 0));
+                      });
+        } else {
+            u8* r = reg8(ins.reg_1);
+            alu_lanes(r, r, soa.f, true, [](u8 x, u8) { return static_cast<u8>(x - 1); },
+                      [](u8, u8, u8 v, u8 f) {
+                          return static_cast<u8>((f & 0x1F) | (v == 0 ? 0x80 : 0) | 0x40 | ((v & 0xF) == 0xF ? 0x20 : 0));
+                      });
+        }
+        return;
+    }
+
+    // ALU A, r / A, d8
+    u8 operand[LANES];
+    const u8* src = operand;
+    if (ins.mode == AM::R_D8) {
+        std::memset(operand, imm8, LANES);
+    } else {
+        src = reg8(ins.reg_2);
+    }
+    switch (ins.type) {
+        case IN::ADD:
+            alu_lanes(soa.a, src, soa.f, true, [](u8 x, u8 y) { return static_cast<u8>(x + y); },
+                      [](u8 x, u8 y, u8 r, u8 f) {
+                          return static_cast<u8>((f & 0x0F) | (r == 0 ? 0x80 : 0) |
+                                                 ((x & 0xF) + (y & 0xF) > 0xF ? 0x20 : 0) | (r < x ? 0x10 : 0));
+                      });
+            break;
+        case IN::SUB:
+        case IN::CP:
+            alu_lanes(soa.a, src, soa.f, ins.type == IN::SUB, [](u8 x, u8 y) { return static_cast<u8>(x - y); },
+                      [](u8 x, u8 y, u8 r, u8 f) {
+                          return static_cast<u8>((f & 0x0F) | (r == 0 ? 0x80 : 0) | 0x40 |
+                                                 ((x & 0xF) < (y & 0xF) ? 0x20 : 0) | (x < y ? 0x10 : 0));
+                      });
+            break;
+        case IN::AND:
+            alu_lanes(soa.a, src, soa.f, true, [](u8 x, u8 y) { return static_cast<u8>(x & y); },
+                      [](u8, u8, u8 r, u8 f) { return static_cast<u8>((f & 0x0F) | (r == 0 ? 0x80 : 0) | 0x20); });
+            break;
+        case IN::XOR:
+            alu_lanes(soa.a, src, soa.f, true, [](u8 x, u8 y) { return static_cast<u8>(x ^ y); },
+                      [](u8, u8, u8 r, u8 f) { return static_cast<u8>((f & 0x0F) | (r == 0 ? 0x80 : 0)); });
+            break;
+        default: // OR
+            alu_lanes(soa.a, src, soa.f, true, [](u8 x, u8 y) { return static_cast<u8>(x | y); },
+                      [](u8, u8, u8 r, u8 f) { return static_cast<u8>((f & 0x0F) | (r == 0 ? 0x80 : 0)); });
+            break;
+    }
+}
@@ -0,0 +1,83 @@
+#include <algorithm>
+
+#include "../headers/block_cache.hpp"
+
+Block* BlockCache::lookup(u32 key) const {
+    auto it = blocks.find(key);
+    return it == blocks.end() ? nullptr : it->second.get();
+}
+
+Block* BlockCache::insert(u32 key, Block block) {
+    erase(key);
+    for (int page = block.start >> 8; page <= (block.end - 1) >> 8; page++) {
+        page_keys[page].push_back(key);
+        if (page_refs[page]++ == 0) {
+            watch(page, true);
+        }
+    }
+    auto& slot = blocks[key];
+    slot = std::make_unique<Block>(std::move(block));
+    return slot.get();
+}
+
+void BlockCache::erase(u32 key) {
+    auto it = blocks.find(key);
+    if (it == blocks.end()) {
+        return;
+    }
+    const Block& block = *it->second;
+    for (int page = block.start >> 8; page <= (block.end - 1) >> 8; page++) {
+        std::vector<u32>& keys = page_keys[page];
+        keys.erase(std::find(keys.begin(), keys.end(), key));
+        if (--page_refs[page] == 0) {
+            watch(page, false);
+        }
+    }
+    blocks.erase(it);
+    gen++;
+}
+
+void BlockCache::invalidate(u16 address) {
+    std::vector<u32>& keys = page_keys[address >> 8];
+    size_t i = 0;
+    while (i < keys.size()) {
+        const Block* block = lookup(keys[i]);
+        if (address >= block->start && address < block->end) {
+            erase(keys[i]); // removes keys[i] from this page's list
+        } else {
+            i++;
+        }
+    }
+}
+
+// Drops every block with code in the page.
+void BlockCache::invalidate_page(u8 page) {
+    while (!page_keys[page].empty()) {
+        erase(page_keys[page].back());
+    }
+}
+
+void BlockCache::clear() {
+    blocks.clear();
+    for (auto& keys : page_keys) {
+        keys.clear();
+    }
+    for (int page = 0; page < 256; page++) {
+        if (page_refs[page] != 0) {
+            page_refs[page] = 0;
+            watch(page, false);
+        }
+    }
+    gen++;
+}
+
+void BlockCache::set_page_watcher(PageWatchHandler handler, void* ctx) {
+    watcher = handler;
+    watcher_ctx = ctx;
+}
+
+void BlockCache::watch(int page, bool watched) {
+    if (watcher) {
+        watcher(watcher_ctx, static_cast<u8>(page), watched);
+    }
+}
@@ -10,8 +10,6 @@
 #define GB_MEMORY_SIZE 0x10000
 #endif
 
-static char serial_data[2];
-
 u8 Bus::io_read(u16 address) {
     if (address == 0xFF01) {
         return serial_data[0];
@@ -29,6 +27,10 @@ u8 Bus::io_read(u16 address) {
         return cpu->get_int_flags();
     }
 
+    if (address >= 0xFF40 && address <= 0xFF4B) {
+        return ppu.read(address);
+    }
+
     // printf("UNSUPPORTED bus_read(%04X)\n", address);
     return 0;
 }
@@ -41,6 +43,18 @@ void Bus::io_write(u16 address, u8 value) {
 
     if (address == 0xFF02) {
         serial_data[1] = value;
+        // Starting a transfer on the internal clock completes it 8 bits later.
+        if ((value & 0x81) == 0x81) {
+            serial_log += static_cast<char>(serial_data[0]);
+            if (trace) {
+                trace->serial(serial_data[0]);
+            }
+            if (sched) {
+                sched->schedule(EventType::SERIAL_DONE, sched->now() + SERIAL_TRANSFER_CYCLES);
+            }
+        } else if (sched) {
+            sched->cancel(EventType::SERIAL_DONE);
+        }
         return;
     }
 
@@ -54,137 +68,276 @@ void Bus::io_write(u16 address, u8 value) {
         return;
     }
 
+    if (address == 0xFF46) {
+        // OAM DMA, done at once rather than over 160 M-cycles.
+        u16 source = value << 8;
+        for (u8 i = 0; i < 0xA0; i++) {
+            ppu.oam_write(i, read(source + i));
+        }
+    }
+
+    if (address >= 0xFF40 && address <= 0xFF4B) {
+        ppu.write(address, value);
+        return;
+    }
+
     // std::cerr<<"UNSUPPORTED bus_write"<<hex<<(int)address;
 }
 
 void Bus::set_cpu(gbCpu* cpu_ptr) {
     cpu = cpu_ptr;
+    ppu.set_cpu(cpu_ptr);
+}
+
+void Bus::set_block_cache(BlockCache* cache) {
+    code_cache = cache;
+    code_cache->set_page_watcher(&Bus::on_page_watch, this);
+}
+
+void Bus::set_scheduler(Scheduler* sched_ptr) {
+    sched = sched_ptr;
+    sched->set_handler(EventType::SERIAL_DONE, &Bus::on_serial_done, this);
+    ppu.set_scheduler(sched_ptr);
+}
+
+// Without drawing the renderer needs no VRAM writes, so VRAM goes back to
+// the fast path.
+void Bus::set_render_interval(u32 frames) {
+    ppu.set_render_interval(frames);
+    for (int page = 0x80; page < 0xA0; page++) {
+        map_page(page, ppu.vram_data() + ((page - 0x80) << 8), frames ? PAGE_VRAM : 0);
+    }
+}
+
+void Bus::set_trace(Trace* trace_ptr) {
+    trace = trace_ptr;
+}
+
+// No link partner: the bits shifted in are all 1s.
+void Bus::on_serial_done(void* ctx, u64) {
+    Bus* bus = static_cast<Bus*>(ctx);
+    bus->serial_data[0] = 0xFF;
+    bus->serial_data[1] &= 0x7F;
+    bus->cpu->request_interrupt(IT_SERIAL);
+}
+
+// First cycle after `from` at which reading address may give a different
+// value, with no write to it or scheduled event in between: `from` itself
+// for DIV and TIMA, which count on their own, the next line or mode change
+// for LY and STAT, and Scheduler::NEVER for everything else.
+u64 Bus::read_stable_until(uint16_t address, u64 from) const {
+    if (address == 0xFF04 || address == 0xFF05) {
+        return from;
+    }
+    return ppu.stable_until(address, from);
+}
+
+// ROM bank mapped at address, 0 outside the ROM windows. Code caches key
+// blocks by it.
+u16 Bus::rom_bank_at(u16 address) const {
+    if (address < 0x4000) {
+        return mbc.rom_bank0();
+    }
+    if (address < 0x8000) {
+        return mbc.rom_bank();
+    }
+    return 0;
 }
 // Bus::Bus(Cart cart_in)
 Bus::Bus(Cart& cart_in, Timer* tmr_ptr, gbCpu* cpu_ptr){ // Initialize cart member
     tmr = tmr_ptr;
-    memory = cart_in.get_rom_data();
-    if (memory.empty()) {
+    rom = cart_in.get_rom();
+    if (!rom) {
         std::cerr << "Error: Unable to read ROM data or ROM data is empty." << std::endl;
         exit(-1);
     }
-    if (memory.size() < GB_MEMORY_SIZE) {
-        memory.resize(GB_MEMORY_SIZE, 0x00);
-    }
+    cart_ram.assign(cart_in.ram_size(), 0x00);
+    mbc = Mbc(cart_in.mbc_type(), rom->size() / 0x4000, cart_ram.size() / 0x2000);
+
     std::fill(std::begin(wram), std::end(wram), 0x00);
     std::fill(std::begin(hram), std::end(hram), 0x00);
     // ie_register = 0x00; // Initialize IE register
-}
 
-uint8_t Bus::wram_read(uint16_t address) {
-    uint16_t offset = address - 0xC000;
-    
-    if (offset >= 0x2000) {
-        std::cerr << "Error: Invalid WRAM read address 0x" << std::hex << address << std::dec << std::endl;
-        exit(-1);
+    map_banks();                                                // ROM, cartridge RAM
+    for (int page = 0x80; page < 0xA0; page++) {
+        map_page(page, ppu.vram_data() + ((page - 0x80) << 8), PAGE_VRAM); // VRAM
+    }
+    for (int page = 0xC0; page < 0xE0; page++) {
+        map_page(page, &wram[(page - 0xC0) << 8], 0);           // WRAM
+    }
+    for (int page = 0xE0; page < 0xFE; page++) {
+        map_page(page, &wram[(page - 0xE0) << 8], 0);           // echo RAM
     }
-    uint8_t result = wram[offset];
-    return result;
+    map_page(0xFE, nullptr, PAGE_IO);                           // OAM, unusable
+    map_page(0xFF, nullptr, PAGE_IO);                           // I/O, HRAM, IE
 }
 
-void Bus::wram_write(uint16_t address, uint8_t value) {
-    uint16_t offset = address - 0xC000;
-    
-    if (offset >= 0x2000) {
-        std::cerr << "Error: Invalid WRAM write address 0x" << std::hex << address << std::dec << std::endl;
-        exit(-1);
-    }
-    wram[offset] = value;
+// Keeps PAGE_WATCHED, which belongs to the code cache.
+void Bus::map_page(u8 page, u8* mem, u8 flags) {
+    pages[page].mem = mem;
+    pages[page].flags = flags | (pages[page].flags & PAGE_WATCHED);
+    update_page(page);
 }
 
-uint8_t Bus::hram_read(uint16_t address) {
-    uint16_t offset = address - 0xFF80;
-    
-    if (offset >= 0x80) {
-        std::cerr << "Error: Invalid HRAM read address 0x" << std::hex << address << std::dec << std::endl;
-        exit(-1);
+// Points the ROM and cartridge RAM windows at the banks the MBC selects.
+void Bus::map_banks() {
+    // ROM pages are PAGE_MBC, so nothing is ever written through these.
+    u8* rom_data = const_cast<u8*>(rom->data());
+    u8* bank0 = rom_data + mbc.rom_bank0() * 0x4000;
+    u8* bank = rom_data + mbc.rom_bank() * 0x4000;
+    for (int page = 0x00; page < 0x40; page++) {
+        map_page(page, bank0 + (page << 8), PAGE_MBC);
+        map_page(page + 0x40, bank + (page << 8), PAGE_MBC);
+    }
+
+    // Disabled or missing RAM and the MBC3 clock registers take the slow path.
+    u8* ram = nullptr;
+    if (mbc.ram_mapped() && !cart_ram.empty()) {
+        ram = &cart_ram[mbc.ram_bank() * 0x2000 % cart_ram.size()];
+    }
+    for (int page = 0xA0; page < 0xC0; page++) {
+        if (ram) {
+            map_page(page, ram + ((page - 0xA0) << 8), 0);
+        } else {
+            map_page(page, nullptr, PAGE_IO);
+        }
     }
-    return hram[offset];
 }
 
-void Bus::hram_write(uint16_t address, uint8_t value) {
-    uint16_t offset = address - 0xFF80;
-    
-    if (offset >= 0x80) {
-        std::cerr << "Error: Invalid HRAM write address 0x" << std::hex << address << std::dec << std::endl;
-        exit(-1);
+void Bus::update_page(u8 page) {
+    const Page& p = pages[page];
+    read_map[page] = (p.flags & PAGE_IO) ? nullptr : p.mem;
+    write_map[page] = p.flags ? nullptr : p.mem;
+}
+
+// Pages with blocks in the code cache take the slow write path so writes
+// can invalidate them. Blocks are never built from echo RAM, but writes
+// through it reach the same WRAM, so the echo page is watched too.
+void Bus::on_page_watch(void* ctx, u8 page, bool watched) {
+    Bus* bus = static_cast<Bus*>(ctx);
+    bus->set_watched(page, watched);
+    if (page >= 0xC0 && page < 0xDE) {
+        bus->set_watched(page + 0x20, watched);
     }
-    hram[offset] = value;
 }
 
+void Bus::set_watched(u8 page, bool watched) {
+    if (watched) {
+        pages[page].flags |= PAGE_WATCHED;
+    } else {
+        pages[page].flags &= ~PAGE_WATCHED;
+    }
+    update_page(page);
+}
 
-uint8_t Bus::read(uint16_t address) {
-    if (address == 0xFF44) {
-        return 0X90; // or however you track LY
+u8 Bus::read_slow(u16 address) {
+    const Page& page = pages[address >> 8];
+    if (!(page.flags & PAGE_IO)) {
+        return page.mem ? page.mem[address & 0xFF] : 0x00;
     }
-    if (address < 0x8000) {
-        // ROM Bank 0 and 1 (Switchable)
-        return memory[address];
-    } else if (address < 0xA000) {
-        // CHR RAM / BG Map Data (VRAM)
-        // std::cerr << "Error: UNSUPPORTED bus_read(VRAM) 0x" << std::hex << address << std::dec << std::endl;
-        return 0x00;
-    } else if (address < 0xC000) {
-        // Cartridge RAM (External RAM)
-        return memory[address];
-    } else if (address < 0xE000) {
-        // WRAM (Working RAM) - Bank 0 and 1-7 (switchable)
-        return wram_read(address);
-    } else if (address < 0xFE00) {
-        return wram_read(address  - 0x2000);
-    } else if (address < 0xFEA0) {
-        // Object Attribute Memory (OAM)
-        // std::cerr << "Error: UNSUPPORTED bus_read(OAM) 0x" << std::hex << address << std::dec << std::endl;
-        return 0x00;
-    } else if (address < 0xFF00) {
-        // Reserved - Unusable
+    if (address < 0xC000) {
+        // Cartridge RAM window without RAM behind it
+        return mbc.rtc_mapped() ? mbc.rtc_read() : 0xFF;
+    }
+    if (address < 0xFEA0) {
+        return ppu.oam_read(address - 0xFE00);
+    }
+    if (address < 0xFF00) {
+        // Unusable area
         return 0x00;
-    } else if (address < 0xFF80) {
+    }
+    if (address < 0xFF80) {
         return io_read(address);
-    } else if (address == 0xFFFF) {
+    }
+    if (address == 0xFFFF) {
         // CPU Interrupt Enable Register (IE)
         return cpu->get_ie_register();
-    } else { // 0xFF80 - 0xFFFE
-        // Zero Page / HRAM (High RAM)
-        return hram_read(address);
     }
+    return hram[address - 0xFF80];
 }
 
-void Bus::write(uint16_t address, uint8_t value) {
-    if (address < 0x8000) {
-        // ROM Data (writes are usually ignored or control MBC)
-        memory[address] = value;
-    } else if (address < 0xA000) {
-        // CHR RAM / BG Map Data (VRAM)
-        // std::cerr << "Error: UNSUPPORTED bus_write(VRAM) 0x" << std::hex << address << std::dec << std::endl;
-    } else if (address < 0xC000) {
-        // Cartridge RAM (External RAM)
-        memory[address] = value;
-    } else if (address < 0xE000) {
-        // WRAM (Working RAM)
-        wram_write(address, value);
-    } else if (address < 0xFE00) {
-        wram_write(address - 0x2000, value);
-    } else if (address < 0xFEA0) {
-        // Object Attribute Memory (OAM)
-        // std::cerr << "Error: UNSUPPORTED bus_write(OAM) 0x" << std::hex << address << std::dec << std::endl;
-    } else if (address < 0xFF00) {
-        // Reserved - Unusable (writes are ignored)
-    } else if (address < 0xFF80) {
-        // I/O Registers
-        io_write(address,value);
-        // std::cerr << "Error: UNSUPPORTED bus_write(IO Registers) 0x" << std::hex << address << std::dec << std::endl;
-    } else if (address == 0xFFFF) {
+void Bus::write_slow(u16 address, u8 value) {
+    const Page& page = pages[address >> 8];
+    if (page.flags & PAGE_MBC) {
+        // ROM itself never changes, so cached code stays valid.
+        if (mbc.write(address, value)) {
+            map_banks();
+            if (code_cache) {
+                code_cache->remap();
+            }
+        }
+        return;
+    }
+    if ((page.flags & PAGE_WATCHED) && code_cache) {
+        // Cached blocks are keyed by their WRAM address, not the echo one.
+        code_cache->invalidate(address >= 0xE000 ? address - 0x2000 : address);
+    }
+    if (page.flags & PAGE_VRAM) {
+        ppu.vram_write(address - 0x8000, value);
+        return;
+    }
+    if (!(page.flags & PAGE_IO)) {
+        if (page.mem) {
+            page.mem[address & 0xFF] = value;
+        }
+        return;
+    }
+    if (address < 0xC000) {
+        // Cartridge RAM window without RAM behind it
+        if (mbc.rtc_mapped()) {
+            mbc.rtc_write(value);
+        }
+        return;
+    }
+    if (address < 0xFEA0) {
+        ppu.oam_write(address - 0xFE00, value);
+        return;
+    }
+    if (address < 0xFF00) {
+        // Unusable area
+        return;
+    }
+    if (address < 0xFF80) {
+        io_write(address, value);
+        return;
+    }
+    if (address == 0xFFFF) {
         // CPU Interrupt Enable Register (IE)
         cpu->set_ie_register(value);
-    } else { // 0xFF80 - 0xFFFE
-        // Zero Page / HRAM (High RAM)
-        hram_write(address, value);
+        return;
+    }
+    hram[address - 0xFF80] = value;
+}
+
+// Memory, serial registers, MBC registers and the PPU. The page table is rebuilt
+// from the MBC on load, and cached code in RAM is dropped since the bytes
+// under it changed.
+size_t Bus::state_size() const {
+    return ppu.state_size() + sizeof(wram) + sizeof(hram) + sizeof(serial_data) + sizeof(mbc) +
+           cart_ram.size();
+}
+
+void Bus::save_state(StateWriter& out) const {
+    ppu.save_state(out);
+    out.pod(wram);
+    out.pod(hram);
+    out.pod(serial_data);
+    out.pod(mbc);
+    out.bytes(cart_ram.data(), cart_ram.size());
+}
+
+void Bus::load_state(StateReader& in) {
+    ppu.load_state(in);
+    in.pod(wram);
+    in.pod(hram);
+    in.pod(serial_data);
+    in.pod(mbc);
+    in.bytes(cart_ram.data(), cart_ram.size());
+    map_banks();
+    if (code_cache) {
+        for (int page = 0x80; page < 0x100; page++) {
+            code_cache->invalidate_page(page);
+        }
     }
 }
 
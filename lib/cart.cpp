@@ -1,35 +1,34 @@
 #include <cstdint>
 #include <vector>
 #include <string>
-#include <fstream>
 #include <iostream>
 
 #include "../headers/cart.hpp"
 
 
-// Reads ROM data from a file and stores it in romData
+// Loads the ROM, sharing the image with any other Cart that has the same
+// file open.
 int Cart::read_rom(const std::string& path) {
-    std::ifstream romFile(path, std::ios::binary | std::ios::ate);
-
-    if (!romFile.is_open()) {
-        std::cerr << "Error: Unable to open ROM file " << path << std::endl;
+    rom = RomImage::open(path);
+    if (!rom) {
         return -1; // Error code
     }
+    return 0; // Success
+}
+std::shared_ptr<const RomImage> Cart::get_rom() const {
+    return rom;
+}
 
-    // Get file size and resize romData accordingly
-    std::streamsize fileSize = romFile.tellg();
-    romData.resize(static_cast<size_t>(fileSize));
+// Cartridge type, from the header byte at 0x0147.
+MbcType Cart::mbc_type() const {
+    return rom && rom->size() > 0x147 ? mbc_type_for(rom->data()[0x147]) : MbcType::NONE;
+}
 
-    // Read ROM data into the vector
-    romFile.seekg(0, std::ios::beg);
-    if (!romFile.read(reinterpret_cast<char*>(romData.data()), fileSize)) {
-        std::cerr << "Error: Failed to read ROM file " << path << std::endl;
-        return -1; // Error code
+// Bytes of cartridge RAM, from the header byte at 0x0149. ROM-only carts get 8 KiB so 0xA000-0xBFFF stays
+// usable as before.
+size_t Cart::ram_size() const {
+    if (mbc_type() == MbcType::NONE) {
+        return 0x2000;
     }
-
-    romFile.close();
-    return 0; // Success
+    return rom && rom->size() > 0x149 ? cart_ram_size(rom->data()[0x149]) : 0;
 }
-std::vector<u8> Cart::get_rom_data(){
-    return romData;
-}
\ No newline at end of file
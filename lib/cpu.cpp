@@ -2,6 +2,7 @@
 #include <iostream>
 #include <ostream>
 #include <iomanip>
+#include <sstream>
 #include <cmath>
 
 #include "../headers/common.hpp"
@@ -9,18 +10,15 @@
 #include "../headers/bus.hpp"
 #include "../headers/instructions.hpp"
 
-#define CPU_FLAG_Z regs.read_flag('Z')
+#define CPU_FLAG_Z regs.flag_z()
 #define CPU_FLAG_N regs.read_flag('N')
 #define CPU_FLAG_H regs.read_flag('H')
-#define CPU_FLAG_C regs.read_flag('C')
-
-char gbCpu::dbg_msg[1024] = {0};
-int gbCpu::msg_size = 0;
+#define CPU_FLAG_C regs.flag_c()
 
 using namespace std;
 
-gbCpu::gbCpu(Bus& bus, Instructions& instr, Timer& timer)
-    : bus(bus), instr(instr), timer(timer), halted(false), interupt_en(false), enabling_ime(false) {
+gbCpu::gbCpu(Bus& bus, Timer& timer, Scheduler& sched)
+    : bus(bus), timer(timer), sched(sched), interupt_en(false), enabling_ime(false), halted(false) {
     
     // Initialize registers with the provided values
     regs.a = 0x01;
@@ -34,15 +32,16 @@ gbCpu::gbCpu(Bus& bus, Instructions& instr, Timer& timer)
     regs.sp = 0xFFFE;
     regs.pc = 0x0100;
 
-    timer.div=0xABCC;
+    timer.set_div_counter(0xABCC);
 
+    bus.set_block_cache(&blocks);
 }
 
-void gbCpu::debug(){
-    std::cout << std::hex << std::uppercase << std::setfill('0'); // Set formatting for hex output
+void gbCpu::debug(std::ostream& out){
+    out << std::hex << std::uppercase << std::setfill('0'); // Set formatting for hex output
 
-    std::cout << "A:" << std::setw(2) << static_cast<int>(regs.a)
-              << " F:" << std::setw(2) << static_cast<int>(regs.f)
+    out << "A:" << std::setw(2) << static_cast<int>(regs.a)
+              << " F:" << std::setw(2) << static_cast<int>(regs.get_f())
               << " B:" << std::setw(2) << static_cast<int>(regs.b)
               << " C:" << std::setw(2) << static_cast<int>(regs.c)
               << " D:" << std::setw(2) << static_cast<int>(regs.d)
@@ -50,43 +49,42 @@ void gbCpu::debug(){
               << " H:" << std::setw(2) << static_cast<int>(regs.h)
               << " L:" << std::setw(2) << static_cast<int>(regs.l);
 
-    std::cout << " SP:" << std::setw(4) << regs.sp
+    out << " SP:" << std::setw(4) << regs.sp
               << " PC:" << std::setw(4) << regs.pc;
 
     // For PCMEM, we might want to reset setfill to default space if subsequent output
     // isn't intended to be zero-padded, or just ensure consistency for bytes.
-    std::cout << " PCMEM:";
-    std::cout << std::setw(2) << static_cast<int>(bus.read(regs.pc)) << ","
+    out << " PCMEM:";
+    out << std::setw(2) << static_cast<int>(bus.read(regs.pc)) << ","
               << std::setw(2) << static_cast<int>(bus.read(regs.pc+1)) << ","
               << std::setw(2) << static_cast<int>(bus.read(regs.pc+2)) << ","
               << std::setw(2) << static_cast<int>(bus.read(regs.pc+3)) << std::endl;
 
     // Optional: Reset stream format to default if this is not the only place hex is used
-    std::cout << std::dec << std::noshowbase << std::setfill(' ');
+    out << std::dec << std::noshowbase << std::setfill(' ');
 }
 
+template<CT cond>
 bool gbCpu::check_cond() {
-    bool flag_z = regs.read_flag('Z');
-    bool flag_c = regs.read_flag('C');
-    // std::cout << "Checking condition: " << (int)curr_ins->cond << " Z:" << flag_z << " C:" << flag_c << std::endl;
-    switch (curr_ins->cond) {
-        case (CT::NONE): return true;
-        case (CT::C): return flag_c;
-        case (CT::NC): return !flag_c;
-        case (CT::Z): return flag_z;
-        case (CT::NZ): return !flag_z;
-        default: return false; // Should not happen
-    }
+    if constexpr (cond == CT::NONE) return true;
+    else if constexpr (cond == CT::C) return regs.flag_c();
+    else if constexpr (cond == CT::NC) return !regs.flag_c();
+    else if constexpr (cond == CT::Z) return regs.flag_z();
+    else return !regs.flag_z(); // CT::NZ
 }
 
+template<CT cond>
 void gbCpu::goto_addr(u16 addr, bool pushpc) {
-    if (check_cond()) {
+    if (check_cond<cond>()) {
         if (pushpc) {
-            timer.emu_cycles(2); 
             stack_push16(regs.pc);
         }
+        cycles = curr_ins->cycles_taken;
+        if (!pushpc && addr < regs.pc) {
+            // A backward jump may close a busy-wait loop.
+            cycles += idle_skip(addr, regs.pc, sched.now() + cycles);
+        }
         regs.pc = addr;
-        timer.emu_cycles(1);
         return;
     }
     return;
@@ -96,30 +94,66 @@ bool gbCpu::step() {
     int i = 0;
     if (!halted) {
         mem_dest = 0;
-        is_mem_dest = false;
-        // debug();
-        fetch();
-        decode();
-        dbg_update();
-        dbg_print();
-        execute();
+        trace_instruction();
+        OpHandler handler = fetch_op();
+        handler(*this);
+        retired++;
         i += 1;
     }
     else{
-        if(int_flags){
-            halted=false;
-        }
+        cycles = halted_cycles();
+    }
+    sched.advance(cycles);
+    update_ime();
+    return !stopped;
+}
+
+// Length of one halted step. Only scheduled events can raise an interrupt
+// flag while the CPU sleeps, so it skips straight to the next one. Only
+// enabled interrupts wake it.
+u32 gbCpu::halted_cycles() {
+    if (int_flags & ie_register) {
+        halted = false;
+        return 1;
     }
-    if (interupt_en) { 
-        cerr<<"ie"<<endl;
-        // exit(-1);
+    u64 next = sched.next_deadline();
+    if (next == Scheduler::NEVER) {
+        return HALT_IDLE_CYCLES;
+    }
+    u64 wait = next - sched.now();
+    return wait > HALT_IDLE_CYCLES ? HALT_IDLE_CYCLES : static_cast<u32>(wait);
+}
+
+// True if the next span M-cycles of register-only instructions can skip
+// their per-instruction epilogue: the CPU is running, IME does not change
+// and no interrupt can be taken before they end.
+bool gbCpu::quiet_for(u32 span) const {
+    if (halted || stopped || enabling_ime) return false;
+    return !interupt_en || (!(int_flags & ie_register) && sched.next_deadline() - sched.now() > span);
+}
+
+// Moves past count instructions that were executed for this CPU elsewhere
+// (see Batch), landing on pc. If they were the next ops of the current
+// block the position in it is kept, so the next fetch needs no lookup;
+// sync_block checks the PC either way. cur_block may have been dropped
+// since the last step, so the generation is checked before it is read.
+void gbCpu::skip_ops(u16 pc, u32 count) {
+    if (cur_block != nullptr && block_gen == blocks.generation() &&
+        block_pos + count < cur_block->ops.size()) {
+        block_pos += count;
+    }
+    regs.pc = pc;
+    retired += count;
+}
+
+void gbCpu::update_ime() {
+    if (interupt_en) {
         cpu_handle_interrupts();
         enabling_ime = false;
     }
     if (enabling_ime) {
         interupt_en = true;
     }
-    return true;
 }
 
 void gbCpu::fetch() {
@@ -127,169 +161,236 @@ void gbCpu::fetch() {
     regs.pc++;
 }
 
-void gbCpu::decode() {
-    curr_ins = instr.Instruction_by_opcode(opcode);
-    if (curr_ins == NULL) {
-        cerr << "Instruction not implemented, opcode: 0x" << hex << static_cast<int>(opcode) << " PC: " << regs.pc << endl;
-        exit(-2);
+// Points cur_block/block_pos at the instruction at PC, looking the block up
+// or building it when PC no longer follows the current one. Returns false
+// when PC is outside cacheable memory.
+bool gbCpu::sync_block() {
+    if (cur_block != nullptr && block_gen == blocks.generation() &&
+        block_pos < cur_block->ops.size() && cur_block->ops[block_pos].pc == regs.pc) {
+        return true;
     }
-    switch (curr_ins->mode) {
-        case (AM::IMP): {
-            break;
-        }
-        case (AM::R): {
-            fetched_data = regs.read_reg(curr_ins->reg_1);
-            break;
-        }
-        case (AM::R_D16):
-        case (AM::D16): {
-            u8 lo = bus.read(regs.pc);
-            timer.emu_cycles(1);
-            u8 hi = bus.read(regs.pc + 1);
-            timer.emu_cycles(1);
-            fetched_data = lo | static_cast<uint16_t>(hi << 8);
-            regs.pc += 2;
-            break;
-        }
-        case AM::R_R: {
-            fetched_data = regs.read_reg(curr_ins->reg_2);
-            break;
-        }
-        case AM::A16_R: {
-            // from Reg to memory 16b addr
-            u8 lo = bus.read(regs.pc);
-            timer.emu_cycles(1);
-            u8 hi = bus.read(regs.pc + 1);
-            timer.emu_cycles(1);
-            is_mem_dest = true;
-            mem_dest = (hi << 8 | lo);
-            regs.pc += 2;
-            fetched_data = regs.read_reg(curr_ins->reg_2);
-            break;
-        }
-        case AM::A8_R: {
-            // from Reg to memory 8b addr
-            u8 lo = bus.read(regs.pc);
-            timer.emu_cycles(1);
-            is_mem_dest = true;
-            mem_dest = 0xFF00 | lo; // A8_R implies high RAM (0xFF00-0xFFFF)
-            regs.pc++; // Only 1 byte offset
-            fetched_data = regs.read_reg(curr_ins->reg_2);
-            break;
-        }
-        case AM::R_A8:
-        case AM::D8:
-        case AM::HL_SPR:
-        case AM::R_D8: {
-            fetched_data = bus.read(regs.pc);
-            timer.emu_cycles(1);
-            regs.pc++;
-            break;
-        }
-        case AM::R_MR: {
-            u16 addr = regs.read_reg(curr_ins->reg_2);
-            if (curr_ins->reg_2 == RT::C) addr |= 0xff00; // For (C) addressing
-            fetched_data = bus.read(addr);
-            timer.emu_cycles(1);
-            break;
-        }
-        case AM::MR_R: {
-            fetched_data = regs.read_reg(curr_ins->reg_2);
-            mem_dest = regs.read_reg(curr_ins->reg_1);
-            is_mem_dest = true;
-            if (curr_ins->reg_1 == RT::C) {
-                mem_dest |= 0xFF00; // For (C) addressing
-            }
-            break;
-        }
-        case AM::MR_D8:
-            fetched_data = bus.read(regs.pc);
-            timer.emu_cycles(1);
-            regs.pc++;
-            mem_dest = regs.read_reg(curr_ins->reg_1);
-            is_mem_dest = true;
-            break;
-        case AM::MR: { 
-            // This seems to be a destination for some operations, but also fetching source.
-           // Review specific opcodes using AM::MR
-            // If it's used as a source (e.g., INC (HL)), then fetched_data should be the value at mem_dest
-            // If it's just a destination, fetched_data might not be relevant here or set elsewhere.
-            // For now, mirroring existing behavior:
-            fetched_data = bus.read(regs.read_reg(curr_ins->reg_1));
-            timer.emu_cycles(1);
-            mem_dest = regs.read_reg(curr_ins->reg_1);
-            is_mem_dest = true;
-            break;
-        }
-        case (AM::R_A16): {
-            u8 lo = bus.read(regs.pc);
-            timer.emu_cycles(1);
-            u8 hi = bus.read(regs.pc + 1);
-            timer.emu_cycles(1);
-            u16 addr = lo | (hi << 8);
-            regs.pc += 2;
-            fetched_data = bus.read(addr); // For (A16) as source
-            break;
-        }
-        case AM::HLI_R: { // (HLI), R -> LD (HL+), R
-            fetched_data = regs.read_reg(curr_ins->reg_2);
-            mem_dest = regs.read_reg(curr_ins->reg_1); // HL
-            is_mem_dest = true;
-            regs.set_reg(RT::HL, regs.read_reg(RT::HL) + 1);
-            break;
-        }
-        case AM::HLD_R: { // (HLD), R -> LD (HL-), R
-            fetched_data = regs.read_reg(curr_ins->reg_2);
-            mem_dest = regs.read_reg(curr_ins->reg_1); // HL
-            is_mem_dest = true;
-            regs.set_reg(RT::HL, regs.read_reg(RT::HL) - 1);
-            break;
-        }
-        case AM::R_HLI: {
-            u16 addr = regs.read_reg(RT::HL);
-            u8 val = bus.read(addr);
-            fetched_data = val;
-            timer.emu_cycles(1);
-            regs.set_reg(RT::HL, addr + 1);
-            break;
-        }
-        
-        case AM::R_HLD: { // R, (HLD) -> LD R, (HL-)
-            fetched_data = bus.read(regs.read_reg(curr_ins->reg_2));
-            timer.emu_cycles(1);
-            regs.set_reg(RT::HL, regs.read_reg(RT::HL) - 1);
-            break;
+    u32 key = BlockCache::key(regs.pc, bus.rom_bank_at(regs.pc));
+    cur_block = blocks.lookup(key);
+    if (cur_block == nullptr) {
+        cur_block = build_block(regs.pc, key);
+    }
+    block_gen = blocks.generation();
+    block_pos = 0;
+    return cur_block != nullptr;
+}
+
+// Fetches the next instruction and returns the handler that executes it.
+// Instructions come from the cached block at PC; PCs outside cacheable
+// memory fall back to fetch() and operand reads through the bus. Returns
+// whether the instruction came from a block, i.e. which handler runs it.
+bool gbCpu::fetch_ins() {
+    if (!sync_block()) {
+        fetch();
+        const DispatchEntry& entry = dispatch[opcode];
+        curr_ins = entry.ins;
+        cycles = entry.cycles;
+        return false;
+    }
+    const MicroOp& op = cur_block->ops[block_pos++];
+    opcode = op.opcode;
+    curr_ins = op.ins;
+    cycles = op.ins->cycles;
+    imm = op.imm;
+    regs.pc++;
+    return true;
+}
+
+OpHandler gbCpu::fetch_op() {
+    const bool prefetched = fetch_ins();
+    const DispatchEntry& entry = dispatch[opcode];
+    return prefetched ? entry.block_handler : entry.handler;
+}
+
+#ifdef ZENBOY_JIT
+// Runs the native translation of the block starting at PC, translating it
+// once it gets hot. The translated ops touch only registers, so skipping
+// their per-instruction epilogue is unobservable as long as no interrupt can
+// be taken in between: that needs IME off, or nothing pending and no
+// scheduled event within the block. Returns the instructions executed, 0 if none.
+int gbCpu::run_native(int budget) {
+    if (!sync_block() || block_pos != 0) return 0;
+    Block& block = *cur_block;
+    if (block.native_epoch != jit.epoch()) {
+        if (block.hits < Jit::HOT_THRESHOLD) {
+            block.hits++;
+            return 0;
         }
+        jit.compile(block);
+    }
+    if (block.native == nullptr || block.native_ops > budget || !quiet_for(block.native_cycles)) return 0;
+    if (tracing<TraceLevel::INSTRUCTION>()) return 0; // trace every instruction
+
+    regs.materialize_flags(); // native code reads and writes F directly
+    sched.advance(reinterpret_cast<Jit::NativeFn>(block.native)(&regs));
+    if (block.native_ops == block.ops.size() && regs.pc == block.start) {
+        sched.advance(idle_skip(block.start, block.end, sched.now()));
+    }
+    block_pos = block.native_ops;
+    retired += block.native_ops;
+    return block.native_ops;
+}
+#endif
+
+// Blocks are only built from memory whose reads have no side effects and do
+// not depend on time: ROM, WRAM and HRAM.
+static bool is_cacheable(u16 start, u32 end) {
+    if (end <= 0x8000) return true;
+    if (start >= 0xC000 && end <= 0xE000) return true;
+    if (start >= 0xFF80 && end <= 0xFFFF) return true;
+    return false;
+}
+
+static bool ends_block(IN type) {
+    switch (type) {
+        case IN::JP:
+        case IN::JR:
+        case IN::CALL:
+        case IN::RET:
+        case IN::RETI:
+        case IN::RST:
+        case IN::HALT:
+        case IN::STOP:
+            return true;
         default:
-            cerr << "Instruction not implemented (decode): " << inst_name(curr_ins->type) << " " << hex << regs.pc << " " << hex << static_cast<int>(opcode) << endl;
-            exit(-2);
+            return false;
+    }
+}
+
+// Decodes forward from pc up to and including the next control transfer.
+Block* gbCpu::build_block(u16 pc, u32 key) {
+    Block block = {};
+    block.start = pc;
+    u32 addr = pc;
+    while (block.ops.size() < BlockCache::MAX_BLOCK_OPS) {
+        if (!is_cacheable(block.start, addr + 1)) break;
+        u8 op = bus.read(addr);
+        const DispatchEntry& entry = dispatch[op];
+        if (entry.ins == NULL || !is_cacheable(block.start, addr + entry.length)) break;
+
+        u16 operands = 0;
+        if (entry.length > 1) operands = bus.read(addr + 1);
+        if (entry.length > 2) operands |= bus.read(addr + 2) << 8;
+        block.ops.push_back(MicroOp{entry.block_handler, entry.ins, static_cast<u16>(addr), operands, op, entry.length});
+        addr += entry.length;
+        if (ends_block(entry.ins->type)) break;
+    }
+    if (block.ops.empty()) {
+        return nullptr;
+    }
+    block.end = addr;
+    return blocks.insert(key, std::move(block));
+}
+
+template<bool prefetched>
+u8 gbCpu::read_operand(u16 offset) {
+    if constexpr (prefetched) {
+        return offset ? (imm >> 8) : (imm & 0xFF);
+    } else {
+        return bus.read(regs.pc + offset);
+    }
+}
+
+template<AM mode, RT r1, RT r2, bool prefetched>
+void gbCpu::decode_mode() {
+    if constexpr (mode == AM::IMP) {
+    } else if constexpr (mode == AM::R) {
+        fetched_data = regs.read_reg<r1>();
+    } else if constexpr (mode == AM::R_D16 || mode == AM::D16) {
+        u8 lo = read_operand<prefetched>(0);
+        u8 hi = read_operand<prefetched>(1);
+        fetched_data = lo | static_cast<uint16_t>(hi << 8);
+        regs.pc += 2;
+    } else if constexpr (mode == AM::R_R) {
+        fetched_data = regs.read_reg<r2>();
+    } else if constexpr (mode == AM::A16_R) {
+        // from Reg to memory 16b addr
+        u8 lo = read_operand<prefetched>(0);
+        u8 hi = read_operand<prefetched>(1);
+        mem_dest = (hi << 8 | lo);
+        regs.pc += 2;
+        fetched_data = regs.read_reg<r2>();
+    } else if constexpr (mode == AM::A8_R) {
+        // from Reg to memory 8b addr
+        u8 lo = read_operand<prefetched>(0);
+        mem_dest = 0xFF00 | lo; // A8_R implies high RAM (0xFF00-0xFFFF)
+        regs.pc++; // Only 1 byte offset
+        fetched_data = regs.read_reg<r2>();
+    } else if constexpr (mode == AM::R_A8 || mode == AM::D8 || mode == AM::HL_SPR || mode == AM::R_D8) {
+        fetched_data = read_operand<prefetched>(0);
+        regs.pc++;
+    } else if constexpr (mode == AM::R_MR) {
+        u16 addr = regs.read_reg<r2>();
+        if constexpr (r2 == RT::C) addr |= 0xff00; // For (C) addressing
+        fetched_data = bus.read(addr);
+    } else if constexpr (mode == AM::MR_R) {
+        fetched_data = regs.read_reg<r2>();
+        mem_dest = regs.read_reg<r1>();
+        if constexpr (r1 == RT::C) {
+            mem_dest |= 0xFF00; // For (C) addressing
+        }
+    } else if constexpr (mode == AM::MR_D8) {
+        fetched_data = read_operand<prefetched>(0);
+        regs.pc++;
+        mem_dest = regs.read_reg<r1>();
+    } else if constexpr (mode == AM::MR) {
+        // Used both as a source and a destination, e.g. INC (HL)
+        fetched_data = bus.read(regs.read_reg<r1>());
+        mem_dest = regs.read_reg<r1>();
+    } else if constexpr (mode == AM::R_A16) {
+        u8 lo = read_operand<prefetched>(0);
+        u8 hi = read_operand<prefetched>(1);
+        u16 addr = lo | (hi << 8);
+        regs.pc += 2;
+        fetched_data = bus.read(addr); // For (A16) as source
+    } else if constexpr (mode == AM::HLI_R) { // (HLI), R -> LD (HL+), R
+        fetched_data = regs.read_reg<r2>();
+        mem_dest = regs.read_reg<r1>(); // HL
+        regs.set_reg<RT::HL>(regs.read_reg<RT::HL>() + 1);
+    } else if constexpr (mode == AM::HLD_R) { // (HLD), R -> LD (HL-), R
+        fetched_data = regs.read_reg<r2>();
+        mem_dest = regs.read_reg<r1>(); // HL
+        regs.set_reg<RT::HL>(regs.read_reg<RT::HL>() - 1);
+    } else if constexpr (mode == AM::R_HLI) {
+        u16 addr = regs.read_reg<RT::HL>();
+        u8 val = bus.read(addr);
+        fetched_data = val;
+        regs.set_reg<RT::HL>(addr + 1);
+    } else if constexpr (mode == AM::R_HLD) { // R, (HLD) -> LD R, (HL-)
+        fetched_data = bus.read(regs.read_reg<r2>());
+        regs.set_reg<RT::HL>(regs.read_reg<RT::HL>() - 1);
+    } else {
+        static_assert(mode != mode, "addressing mode has no decoder");
     }
 }
 
 // --- Helper Functions for Execution (Private members of gbCpu) ---
 
 void gbCpu::cpu_set_flags(int8_t z, int8_t n, int8_t h, int8_t c) {
+    regs.materialize_flags();
+    u8 f = regs.f;
     if (z != -1) {
-        regs.set_flag('Z', z);
+        f = (f & ~0x80) | (z ? 0x80 : 0);
     }
     if (n != -1) {
-        regs.set_flag('N', n);
+        f = (f & ~0x40) | (n ? 0x40 : 0);
     }
     if (h != -1) {
-        regs.set_flag('H', h);
+        f = (f & ~0x20) | (h ? 0x20 : 0);
     }
     if (c != -1) {
-        regs.set_flag('C', c);
+        f = (f & ~0x10) | (c ? 0x10 : 0);
     }
-}
-
-bool gbCpu::is_16_bit(RT reg_type) {
-    return reg_type == RT::AF || reg_type == RT::BC || reg_type == RT::DE || reg_type == RT::HL || reg_type == RT::SP;
+    regs.f = f;
 }
 
 void gbCpu::proc_none() {
     cerr << "INVALID INSTRUCTION!" << endl;
-    exit(-7);
+    stopped = true;
 }
 
 void gbCpu::proc_nop() {
@@ -297,125 +398,94 @@ void gbCpu::proc_nop() {
 }
 
 void gbCpu::proc_cb() {
-    u8 op = fetched_data;
-    RT reg = RT::NONE;
+    cb_dispatch[fetched_data & 0xFF](*this);
+}
 
+template<u8 op>
+void gbCpu::proc_cb_op() {
     // Decode register based on lower 3 bits (0b111)
-    u8 reg_code = op & 0b111;
-    switch (reg_code) {
-        case 0b000: reg = RT::B; break;
-        case 0b001: reg = RT::C; break;
-        case 0b010: reg = RT::D; break;
-        case 0b011: reg = RT::E; break;
-        case 0b100: reg = RT::H; break;
-        case 0b101: reg = RT::L; break;
-        case 0b110: reg = RT::HL; break; // (HL)
-        case 0b111: reg = RT::A; break;
-    }
-
-    u8 bit = (op >> 3) & 0b111;
-    u8 bit_op = (op >> 6) & 0b11;
+    constexpr u8 reg_code = op & 0b111;
+    constexpr RT reg = reg_code == 0b000 ? RT::B
+                     : reg_code == 0b001 ? RT::C
+                     : reg_code == 0b010 ? RT::D
+                     : reg_code == 0b011 ? RT::E
+                     : reg_code == 0b100 ? RT::H
+                     : reg_code == 0b101 ? RT::L
+                     : reg_code == 0b110 ? RT::HL // (HL)
+                     : RT::A;
+
+    constexpr u8 bit = (op >> 3) & 0b111;
+    constexpr u8 bit_op = (op >> 6) & 0b11;
 
     u8 reg_val = 0;
-    if (reg == RT::HL) {
-        reg_val = bus.read(regs.read_reg(RT::HL));
-        timer.emu_cycles(1); // Additional cycle for (HL) access
+    if constexpr (reg == RT::HL) {
+        reg_val = bus.read(regs.read_reg<RT::HL>());
     } else {
-        reg_val = regs.read_reg(reg);
+        reg_val = regs.read_reg<reg>();
     }
-    timer.emu_cycles(1); // General cycle for CB instruction
+    cycles = cb_cycles(op);
 
-    switch (bit_op) {
-        case 1: { // BIT
-            cpu_set_flags(!(reg_val & (1 << bit)), 0, 1, -1);
-            break;
-        }
-        case 2: { // RST (RESET BIT)
-            reg_val &= ~(1 << bit);
-            if (reg == RT::HL) {
-                bus.write(regs.read_reg(RT::HL), reg_val);
-                timer.emu_cycles(1); // Additional cycle for write to (HL)
-            } else {
-                regs.set_reg(reg, reg_val);
-            }
-            break;
+    auto store = [this](u8 value) {
+        if constexpr (reg == RT::HL) {
+            bus.write(regs.read_reg<RT::HL>(), value);
+        } else {
+            regs.set_reg<reg>(value);
         }
-        case 3: { // SET (SET BIT)
-            reg_val |= (1 << bit);
-            if (reg == RT::HL) {
-                bus.write(regs.read_reg(RT::HL), reg_val);
-                timer.emu_cycles(1); // Additional cycle for write to (HL)
-            } else {
-                regs.set_reg(reg, reg_val);
-            }
-            break;
-        }
-        case 0: { // Rotations/Shifts
-            switch (bit) {
-                case 0: { // RLC
-                    bool setC = false;
-                    u8 result = (reg_val << 1) & 0xFF;
-                    if ((reg_val & (1 << 7)) != 0) {
-                        result |= 1;
-                        setC = true;
-                    }
-                    if (reg == RT::HL) { bus.write(regs.read_reg(RT::HL), result); timer.emu_cycles(1); } else { regs.set_reg(reg, result); }
-                    cpu_set_flags(result == 0, 0, 0, setC);
-                    break;
-                }
-                case 1: { // RRC
-                    u8 old = reg_val;
-                    reg_val >>= 1;
-                    reg_val |= (old << 7);
-                    if (reg == RT::HL) { bus.write(regs.read_reg(RT::HL), reg_val); timer.emu_cycles(1); } else { regs.set_reg(reg, reg_val); }
-                    cpu_set_flags(!reg_val, 0, 0, old & 1);
-                    break;
-                }
-                case 2: { // RL
-                    u8 old = reg_val;
-                    u8 cf = CPU_FLAG_C;
-                    reg_val <<= 1;
-                    reg_val |= cf;
-                    if (reg == RT::HL) { bus.write(regs.read_reg(RT::HL), reg_val); timer.emu_cycles(1); } else { regs.set_reg(reg, reg_val); }
-                    cpu_set_flags(!reg_val, 0, 0, !!(old & 0x80));
-                    break;
-                }
-                case 3: { // RR
-                    u8 old = reg_val;
-                    reg_val >>= 1;
-                    reg_val |= (CPU_FLAG_C << 7);
-                    if (reg == RT::HL) { bus.write(regs.read_reg(RT::HL), reg_val); timer.emu_cycles(1); } else { regs.set_reg(reg, reg_val); }
-                    cpu_set_flags(!reg_val, 0, 0, old & 1);
-                    break;
-                }
-                case 4: { // SLA (Shift Left Arithmetic)
-                    u8 old = reg_val;
-                    reg_val <<= 1;
-                    if (reg == RT::HL) { bus.write(regs.read_reg(RT::HL), reg_val); timer.emu_cycles(1); } else { regs.set_reg(reg, reg_val); }
-                    cpu_set_flags(!reg_val, 0, 0, !!(old & 0x80));
-                    break;
-                }
-                case 5: { // SRA (Shift Right Arithmetic)
-                    u8 u = (int8_t)reg_val >> 1; // Signed shift to preserve bit 7
-                    if (reg == RT::HL) { bus.write(regs.read_reg(RT::HL), u); timer.emu_cycles(1); } else { regs.set_reg(reg, u); }
-                    cpu_set_flags(!u, 0, 0, reg_val & 1);
-                    break;
-                }
-                case 6: { // SWAP
-                    reg_val = ((reg_val & 0xF0) >> 4) | ((reg_val & 0xF) << 4);
-                    if (reg == RT::HL) { bus.write(regs.read_reg(RT::HL), reg_val); timer.emu_cycles(1); } else { regs.set_reg(reg, reg_val); }
-                    cpu_set_flags(reg_val == 0, 0, 0, 0);
-                    break;
-                }
-                case 7: { // SRL (Shift Right Logical)
-                    u8 u = reg_val >> 1; // Unsigned shift
-                    if (reg == RT::HL) { bus.write(regs.read_reg(RT::HL), u); timer.emu_cycles(1); } else { regs.set_reg(reg, u); }
-                    cpu_set_flags(!u, 0, 0, reg_val & 1);
-                    break;
-                }
-            }
-            break;
+    };
+
+    if constexpr (bit_op == 1) { // BIT
+        cpu_set_flags(!(reg_val & (1 << bit)), 0, 1, -1);
+    } else if constexpr (bit_op == 2) { // RST (RESET BIT)
+        reg_val &= ~(1 << bit);
+        store(reg_val);
+    } else if constexpr (bit_op == 3) { // SET (SET BIT)
+        reg_val |= (1 << bit);
+        store(reg_val);
+    } else if constexpr (bit == 0) { // RLC
+        bool setC = false;
+        u8 result = (reg_val << 1) & 0xFF;
+        if ((reg_val & (1 << 7)) != 0) {
+            result |= 1;
+            setC = true;
         }
+        store(result);
+        cpu_set_flags(result == 0, 0, 0, setC);
+    } else if constexpr (bit == 1) { // RRC
+        u8 old = reg_val;
+        reg_val >>= 1;
+        reg_val |= (old << 7);
+        store(reg_val);
+        cpu_set_flags(!reg_val, 0, 0, old & 1);
+    } else if constexpr (bit == 2) { // RL
+        u8 old = reg_val;
+        u8 cf = CPU_FLAG_C;
+        reg_val <<= 1;
+        reg_val |= cf;
+        store(reg_val);
+        cpu_set_flags(!reg_val, 0, 0, !!(old & 0x80));
+    } else if constexpr (bit == 3) { // RR
+        u8 old = reg_val;
+        reg_val >>= 1;
+        reg_val |= (CPU_FLAG_C << 7);
+        store(reg_val);
+        cpu_set_flags(!reg_val, 0, 0, old & 1);
+    } else if constexpr (bit == 4) { // SLA (Shift Left Arithmetic)
+        u8 old = reg_val;
+        reg_val <<= 1;
+        store(reg_val);
+        cpu_set_flags(!reg_val, 0, 0, !!(old & 0x80));
+    } else if constexpr (bit == 5) { // SRA (Shift Right Arithmetic)
+        u8 u = (int8_t)reg_val >> 1; // Signed shift to preserve bit 7
+        store(u);
+        cpu_set_flags(!u, 0, 0, reg_val & 1);
+    } else if constexpr (bit == 6) { // SWAP
+        reg_val = ((reg_val & 0xF0) >> 4) | ((reg_val & 0xF) << 4);
+        store(reg_val);
+        cpu_set_flags(reg_val == 0, 0, 0, 0);
+    } else { // SRL (Shift Right Logical)
+        u8 u = reg_val >> 1; // Unsigned shift
+        store(u);
+        cpu_set_flags(!u, 0, 0, reg_val & 1);
     }
 }
 
@@ -450,9 +520,10 @@ void gbCpu::proc_rra() {
     cpu_set_flags(0, 0, 0, new_c);
 }
 
+// There is no joypad to wake the CPU, so STOP sleeps like HALT until an
+// interrupt is requested.
 void gbCpu::proc_stop() {
-    cerr << "STOPPING! (Instruction not fully implemented)" << endl;
-    // In a real emulator, this would handle STOP mode
+    halted = true;
 }
 
 void gbCpu::proc_daa() {
@@ -488,23 +559,21 @@ void gbCpu::proc_halt() {
 
 void gbCpu::proc_and() {
     regs.a &= fetched_data;
-    cpu_set_flags(regs.a == 0, 0, 1, 0);
+    regs.lazy_flags(FlagOp::AND, 0, 0, regs.a);
 }
 
 void gbCpu::proc_xor() {
     regs.a ^= fetched_data & 0xFF;
-    cpu_set_flags(regs.a == 0, 0, 0, 0);
+    regs.lazy_flags(FlagOp::OR_XOR, 0, 0, regs.a);
 }
 
 void gbCpu::proc_or() {
     regs.a |= fetched_data & 0xFF;
-    cpu_set_flags(regs.a == 0, 0, 0, 0);
+    regs.lazy_flags(FlagOp::OR_XOR, 0, 0, regs.a);
 }
 
 void gbCpu::proc_cp() {
-    int n = (int)regs.a - (int)fetched_data;
-    cpu_set_flags(n == 0, 1,
-                  ((int)regs.a & 0x0F) - ((int)fetched_data & 0x0F) < 0, n < 0);
+    regs.lazy_flags(FlagOp::SUB, regs.a, fetched_data, regs.a - fetched_data);
 }
 
 void gbCpu::proc_di() {
@@ -515,157 +584,153 @@ void gbCpu::proc_ei() {
     enabling_ime = true; // Set a flag to enable interrupts after the next instruction
 }
 
+// Modes whose decode leaves the destination address in mem_dest.
+static constexpr bool writes_memory(AM mode) {
+    return mode == AM::A16_R || mode == AM::A8_R || mode == AM::MR_R || mode == AM::MR_D8 ||
+           mode == AM::MR || mode == AM::HLI_R || mode == AM::HLD_R;
+}
+
+template<AM mode, RT r1, RT r2>
 void gbCpu::proc_ld() {
-    if (is_mem_dest) {
-        
-        if (curr_ins->mode == AM::A16_R && curr_ins->reg_2 == RT::SP) { // Check if source or dest is 16-bit to determine write size
+    if constexpr (writes_memory(mode)) {
+        if constexpr (mode == AM::A16_R && r2 == RT::SP) { // Check if source or dest is 16-bit to determine write size
             // If reg_2 is 16-bit (like LD (A16), SP), fetched_data is 16-bit
             // If reg_1 is 16-bit (like LD SP, (HL)), fetched_data is also 16-bit after being read.
             bus.write16(mem_dest, fetched_data);
-            timer.emu_cycles(1);
-            if(curr_ins->reg_1 == RT::SP){
-                regs.set_reg(RT::SP, fetched_data);
+            if constexpr (r1 == RT::SP){
+                regs.set_reg<RT::SP>(fetched_data);
             }
         } else {
             bus.write(mem_dest, fetched_data & 0xFF); // Ensure 8-bit write
         }
-        timer.emu_cycles(1); // Additional cycle for memory write
         return;
     }
 
-    if (curr_ins->mode == AM::HL_SPR) {
+    if constexpr (mode == AM::HL_SPR) {
         // LD HL, SP+r8
         s8 signed_offset = static_cast<s8>(fetched_data);
-        u16 sp_val = regs.read_reg(RT::SP);
+        u16 sp_val = regs.read_reg<RT::SP>();
 
         u8 hflag = ((sp_val & 0xF) + (signed_offset & 0xF)) >= 0x10;
         u8 cflag = ((sp_val & 0xFF) + (signed_offset & 0xFF)) >= 0x100;
 
         cpu_set_flags(0, 0, hflag, cflag);
-        regs.set_reg(curr_ins->reg_1, sp_val + signed_offset);
-        timer.emu_cycles(1); 
+        regs.set_reg<r1>(sp_val + signed_offset);
         return;
     }
 
     // Standard LD R, N or LD R1, R2
-    regs.set_reg(curr_ins->reg_1, fetched_data);
+    regs.set_reg<r1>(fetched_data);
 }
 
+template<RT r1>
 void gbCpu::proc_ldh() {
-    if (curr_ins->reg_1 == RT::A) { // LDH A, (a8)
-        regs.set_reg(curr_ins->reg_1, bus.read(0xFF00 | fetched_data));
+    if constexpr (r1 == RT::A) { // LDH A, (a8)
+        regs.set_reg<r1>(bus.read(0xFF00 | fetched_data));
     } else { // LDH (a8), A
         bus.write(mem_dest, regs.a); // mem_dest would be 0xFF00 | offset
     }
-    timer.emu_cycles(1); 
 }
 
+template<CT cond>
 void gbCpu::proc_jp() {
-    goto_addr(fetched_data, false);
+    goto_addr<cond>(fetched_data, false);
     return;
 }
 
+template<CT cond>
 void gbCpu::proc_jr() {
     s8 rel = static_cast<s8>(fetched_data); // fetched_data is u8, cast to s8 for signed relative jump
     u16 addr = regs.pc + rel;
-    goto_addr(addr, false);
+    goto_addr<cond>(addr, false);
     return;
 }
 
+template<CT cond>
 void gbCpu::proc_call() {
-    goto_addr(fetched_data, true);
+    goto_addr<cond>(fetched_data, true);
 }
 
+template<u8 param>
 void gbCpu::proc_rst() {
-    // curr_ins->param holds the RST address (0x00, 0x08, etc.)
-    goto_addr(curr_ins->param, true);
+    // param holds the RST address (0x00, 0x08, etc.)
+    goto_addr<CT::NONE>(param, true);
 }
 
+template<CT cond>
 void gbCpu::proc_ret() {
-    if (curr_ins->cond != CT::NONE) {
-        timer.emu_cycles(1); // Additional cycle if condition is present
-    }
-    if (check_cond()) {
+    if (check_cond<cond>()) {
         u16 lo = bus.read(regs.sp);
-        timer.emu_cycles(1);
         u16 hi = bus.read(regs.sp + 1);
-        timer.emu_cycles(1);
         u16 n = (hi << 8) | lo;
         regs.pc = n;
         regs.sp += 2; // Increment SP after pop
-        timer.emu_cycles(1); 
+        cycles = curr_ins->cycles_taken;
     }
 }
 
 void gbCpu::proc_reti() {
     interupt_en = true;
-    proc_ret(); // RETI is essentially RET + EI
+    proc_ret<CT::NONE>(); // RETI is essentially RET + EI
 }
 
+template<RT r1>
 void gbCpu::proc_pop() {
     u16 n = stack_pop16();
-    timer.emu_cycles(2);  // 2 cycles for 16-bit pop
-    if (curr_ins->reg_1 == RT::HL) {
+    if constexpr (r1 == RT::HL) {
         regs.h = (n >> 8);
         regs.l = (n & 0xFF);
-    } else if (curr_ins->reg_1 == RT::AF) {
+    } else if constexpr (r1 == RT::AF) {
         regs.a = (n >> 8);
-        regs.f = (n & 0xF0); // lower 4 bits must be 0
+        regs.set_f(n & 0xF0); // lower 4 bits must be 0
     } else {
-        regs.set_reg(curr_ins->reg_1, n);
+        regs.set_reg<r1>(n);
     }
 }
 
+template<RT r1>
 void gbCpu::proc_push() {
-    u16 val = regs.read_reg(curr_ins->reg_1);
+    u16 val = regs.read_reg<r1>();
     u8 hi = (val >> 8) & 0xFF;
     u8 lo = val & 0xFF;
 
     regs.sp -= 1;
     bus.write(regs.sp, hi);
-    timer.emu_cycles(1);
 
     regs.sp -= 1;
     bus.write(regs.sp, lo);
-    timer.emu_cycles(1);
 
-    timer.emu_cycles(1);
 }
+
+template<AM mode, RT r1>
 void gbCpu::proc_inc() {
     u16 val; // This will hold the incremented value before final assignment/truncation
     u8 original_8bit_val = 0; // To store the original 8-bit value for H-flag calculation
-    bool sixteen_bit = is_16_bit(curr_ins->reg_1);
+    constexpr bool sixteen_bit = is_16_bit(r1);
 
     // Handle INC (HL) - 8-bit increment of memory at HL
-    if (curr_ins->reg_1 == RT::HL && curr_ins->mode == AM::MR) {
-        u16 hl_addr = regs.read_reg(RT::HL);
+    if constexpr (r1 == RT::HL && mode == AM::MR) {
+        u16 hl_addr = regs.read_reg<RT::HL>();
         original_8bit_val = bus.read(hl_addr); // Read original value from memory
         val = original_8bit_val + 1;
         bus.write(hl_addr, static_cast<u8>(val & 0xFF)); // Write back 8-bit result (handles wrap-around)
-        timer.emu_cycles(1); // Cycle for memory write
 
         // Flags for INC (HL) - 8-bit operation
         // Z flag: Set if result is 0
         // N flag: Reset (0)
         // H flag: Set if carry from bit 3 to bit 4 (i.e., original lower nibble was 0xF)
-        // C flag: Unaffected (-1)
-        cpu_set_flags(
-            (val & 0xFF) == 0,                  // Z flag
-            0,                                  // N flag (always 0 for INC)
-            (original_8bit_val & 0x0F) == 0x0F, // H flag
-            -1                                  // C flag (unaffected)
-        );
+        // C flag: Unaffected
+        regs.lazy_flags(FlagOp::INC, original_8bit_val, 1, val & 0xFF);
         return; // INC (HL) is complete, return early
     }
 
     // Handle INC R (8-bit register) or INC RR (16-bit register)
-    u16 old_reg_val = regs.read_reg(curr_ins->reg_1); // Get original register value
+    u16 old_reg_val = regs.read_reg<r1>(); // Get original register value
 
-    if (sixteen_bit) {
+    if constexpr (sixteen_bit) {
         // 16-bit INC (e.g., INC BC, INC DE, INC HL, INC SP)
         val = old_reg_val + 1;
-        regs.set_reg(curr_ins->reg_1, val);
-        timer.emu_cycles(1); // Additional cycle for 16-bit register increment
+        regs.set_reg<r1>(val);
 
         // 16-bit INC instructions do NOT affect any flags.
         // We explicitly do NOT call cpu_set_flags here to preserve existing flags.
@@ -675,78 +740,57 @@ void gbCpu::proc_inc() {
     // Handle INC R (8-bit register) - e.g., INC A, INC B, INC E
     original_8bit_val = static_cast<u8>(old_reg_val); // Get original 8-bit value for H-flag
     val = original_8bit_val + 1; // Perform 8-bit increment
-    regs.set_reg(curr_ins->reg_1, static_cast<u8>(val & 0xFF)); // Set register, ensures 8-bit wrap-around
+    regs.set_reg<r1>(static_cast<u8>(val & 0xFF)); // Set register, ensures 8-bit wrap-around
 
-    // Flags for 8-bit INC R
-    // Z flag: Set if result is 0
-    // N flag: Reset (0)
-    // H flag: Set if carry from bit 3 to bit 4 (i.e., original lower nibble was 0xF)
-    // C flag: Unaffected (-1)
-    cpu_set_flags(
-        (val & 0xFF) == 0,                  // Z flag
-        0,                                  // N flag (always 0 for INC)
-        (original_8bit_val & 0x0F) == 0x0F, // H flag
-        -1                                  // C flag (unaffected)
-    );
+    // Flags for 8-bit INC R, as for INC (HL)
+    regs.lazy_flags(FlagOp::INC, original_8bit_val, 1, val & 0xFF);
 }
 
 // Corrected proc_dec function
+template<AM mode, RT r1>
 void gbCpu::proc_dec() {
     // Handle DEC (HL) first, as it's a special 8-bit memory operation
-    if (curr_ins->reg_1 == RT::HL && curr_ins->mode == AM::MR) {
-        u16 addr = regs.read_reg(RT::HL);
+    if constexpr (r1 == RT::HL && mode == AM::MR) {
+        u16 addr = regs.read_reg<RT::HL>();
         u8 original_val = bus.read(addr);
         u8 result = original_val - 1;
         bus.write(addr, result);
-        timer.emu_cycles(1); // For memory write
-
-        // Set flags for 8-bit DEC
-        cpu_set_flags(
-            result == 0,       // Z flag
-            1,                 // N flag
-            (original_val & 0x0F) < (result & 0x0F), // H flag (check for borrow from bit 4)
-            -1                 // C flag is unaffected
-        );
+
+        // Flags for 8-bit DEC: Z, N set, H on borrow from bit 4, C unaffected
+        regs.lazy_flags(FlagOp::DEC, original_val, 1, result);
         return; // Operation complete
     }
 
-    bool sixteen_bit = is_16_bit(curr_ins->reg_1);
-    u16 val = regs.read_reg(curr_ins->reg_1) - 1;
+    constexpr bool sixteen_bit = is_16_bit(r1);
+    u16 val = regs.read_reg<r1>() - 1;
 
     // Handle 16-bit register DEC (BC, DE, HL, SP)
-    if (sixteen_bit) {
-        regs.set_reg(curr_ins->reg_1, val);
-        timer.emu_cycles(1);
+    if constexpr (sixteen_bit) {
+        regs.set_reg<r1>(val);
         // 16-bit DEC does not affect flags, so we return
         return;
     }
 
     // Handle 8-bit register DEC (A, B, C, D, E, H, L)
-    regs.set_reg(curr_ins->reg_1, val);
+    regs.set_reg<r1>(val);
     u8 original_val = static_cast<u8>(val + 1);
     u8 result = static_cast<u8>(val);
-    
-    cpu_set_flags(
-        result == 0,
-        1,
-        (original_val & 0x0F) < (result & 0x0F),
-        -1
-    );
+
+    regs.lazy_flags(FlagOp::DEC, original_val, 1, result);
 }
+
+template<RT r1>
 void gbCpu::proc_sub() {
-    u16 reg1_val = regs.read_reg(curr_ins->reg_1); // Assuming reg_1 is A
+    u16 reg1_val = regs.read_reg<r1>(); // Assuming reg_1 is A
     u16 val = reg1_val - fetched_data;
 
-    int z = (val & 0xFF) == 0;
-    int h = ((int)reg1_val & 0x0F) - ((int)fetched_data & 0x0F) < 0;
-    int c = ((int)reg1_val) - ((int)fetched_data) < 0;
-
-    regs.set_reg(curr_ins->reg_1, val & 0xFF);
-    cpu_set_flags(z, 1, h, c);
+    regs.set_reg<r1>(val & 0xFF);
+    regs.lazy_flags(FlagOp::SUB, reg1_val, fetched_data, val);
 }
 
+template<RT r1>
 void gbCpu::proc_sbc() {
-    u8 a = regs.read_reg(curr_ins->reg_1);     // A register
+    u8 a = regs.read_reg<r1>();     // A register
     u8 imm = fetched_data;                     // immediate byte
     u8 carry = CPU_FLAG_C;                  // actual carry bit
 
@@ -757,7 +801,7 @@ void gbCpu::proc_sbc() {
     int h = ((a & 0x0F) < ((imm & 0x0F) + carry));
     int c = (a < rhs);
 
-    regs.set_reg(curr_ins->reg_1, diff & 0xFF);
+    regs.set_reg<r1>(diff & 0xFF);
     cpu_set_flags(z, 1, h, c);
 }
 
@@ -774,14 +818,15 @@ void gbCpu::proc_adc() {
                   a + u + c > 0xFF); // Carry
 }
 
+template<RT r1>
 void gbCpu::proc_add() {
-    bool is_16bit = is_16_bit(curr_ins->reg_1);
-    u16 a = regs.read_reg(curr_ins->reg_1);
+    constexpr bool is_16bit = is_16_bit(r1);
+    u16 a = regs.read_reg<r1>();
     u32 sum;
 
     int z = -1, h = 0, c = 0;
 
-    if (is_16bit && curr_ins->reg_1 == RT::SP) {
+    if constexpr (is_16bit && r1 == RT::SP) {
         s8 imm = (s8)fetched_data;
 
         sum = a + imm;
@@ -789,72 +834,126 @@ void gbCpu::proc_add() {
         z = 0;
         h = ((a & 0x0F) + ((u8)imm & 0x0F)) > 0x0F;
         c = ((a & 0xFF) + (u8)imm) > 0xFF;
-        timer.emu_cycles(1);
     }
 
     // --- ADD HL, rr ---
-    else if (is_16bit) {
+    else if constexpr (is_16bit) {
         sum = a + fetched_data;
 
         h = ((a & 0x0FFF) + (fetched_data & 0x0FFF)) > 0x0FFF;
         c = sum > 0xFFFF;
-        timer.emu_cycles(1);
     }
 
     // --- ADD A, imm8 ---
     else {
         sum = a + fetched_data;
-
-        z = ((sum & 0xFF) == 0);
-        h = ((a & 0x0F) + (fetched_data & 0x0F)) > 0x0F;
-        c = sum > 0xFF;
+        regs.set_reg<r1>(sum & 0xFF);
+        regs.lazy_flags(FlagOp::ADD, a, fetched_data, sum);
+        return;
     }
 
-    regs.set_reg(curr_ins->reg_1, sum & 0xFFFF);
+    regs.set_reg<r1>(sum & 0xFFFF);
     cpu_set_flags(z, 0, h, c);
 }
 
-// --- Main Execute Function ---
-void gbCpu::execute() {
-    switch (curr_ins->type) {
-        case IN::NONE:    proc_none(); break;
-        case IN::NOP:     proc_nop(); break;
-        case IN::JP:      proc_jp(); break;
-        case IN::XOR:     proc_xor(); break;
-        case IN::LD:      proc_ld(); break;
-        case IN::LDH:     proc_ldh(); break;
-        case IN::ADD:     proc_add(); break;
-        case IN::DEC:     proc_dec(); break;
-        case IN::DI:      proc_di(); break;
-        case IN::JR:      proc_jr(); break;
-        case IN::RRA:     proc_rra(); break;
-        case IN::RRCA:    proc_rrca(); break;
-        case IN::RLA:     proc_rla(); break;
-        case IN::RLCA:    proc_rlca(); break;
-        case IN::OR:      proc_or(); break;
-        case IN::INC:     proc_inc(); break;
-        case IN::CALL:    proc_call(); break;
-        case IN::RET:     proc_ret(); break;
-        case IN::RST:     proc_rst(); break;
-        case IN::POP:     proc_pop(); break;
-        case IN::PUSH:    proc_push(); break;
-        case IN::SUB:     proc_sub(); break;
-        case IN::SBC:     proc_sbc(); break;
-        case IN::ADC:     proc_adc(); break;
-        case IN::AND:     proc_and(); break;
-        case IN::CP:      proc_cp(); break;
-        case IN::CB:      proc_cb(); break;
-        case IN::STOP:    proc_stop(); break;
-        case IN::HALT:    proc_halt(); break;
-        case IN::DAA:     proc_daa(); break;
-        case IN::CPL:     proc_cpl(); break;
-        case IN::SCF:     proc_scf(); break;
-        case IN::CCF:     proc_ccf(); break;
-        case IN::EI:      proc_ei(); break;
-        case IN::RETI:    proc_reti(); break;
-        default:
-            cerr << "Execute not implemented: " << inst_name(curr_ins->type) << " OP: 0X" << uppercase << hex << static_cast<int>(opcode) << " PC: " << regs.pc << endl;
-            exit(-3);
-            break;
+// --- Instruction dispatch ---
+
+template<IN type, AM mode, RT r1, RT r2, CT cond, u8 param>
+void gbCpu::execute_type() {
+    if constexpr (type == IN::NONE) proc_none();
+    else if constexpr (type == IN::NOP) proc_nop();
+    else if constexpr (type == IN::JP) proc_jp<cond>();
+    else if constexpr (type == IN::XOR) proc_xor();
+    else if constexpr (type == IN::LD) proc_ld<mode, r1, r2>();
+    else if constexpr (type == IN::LDH) proc_ldh<r1>();
+    else if constexpr (type == IN::ADD) proc_add<r1>();
+    else if constexpr (type == IN::DEC) proc_dec<mode, r1>();
+    else if constexpr (type == IN::DI) proc_di();
+    else if constexpr (type == IN::JR) proc_jr<cond>();
+    else if constexpr (type == IN::RRA) proc_rra();
+    else if constexpr (type == IN::RRCA) proc_rrca();
+    else if constexpr (type == IN::RLA) proc_rla();
+    else if constexpr (type == IN::RLCA) proc_rlca();
+    else if constexpr (type == IN::OR) proc_or();
+    else if constexpr (type == IN::INC) proc_inc<mode, r1>();
+    else if constexpr (type == IN::CALL) proc_call<cond>();
+    else if constexpr (type == IN::RET) proc_ret<cond>();
+    else if constexpr (type == IN::RST) proc_rst<param>();
+    else if constexpr (type == IN::POP) proc_pop<r1>();
+    else if constexpr (type == IN::PUSH) proc_push<r1>();
+    else if constexpr (type == IN::SUB) proc_sub<r1>();
+    else if constexpr (type == IN::SBC) proc_sbc<r1>();
+    else if constexpr (type == IN::ADC) proc_adc();
+    else if constexpr (type == IN::AND) proc_and();
+    else if constexpr (type == IN::CP) proc_cp();
+    else if constexpr (type == IN::CB) proc_cb();
+    else if constexpr (type == IN::STOP) proc_stop();
+    else if constexpr (type == IN::HALT) proc_halt();
+    else if constexpr (type == IN::DAA) proc_daa();
+    else if constexpr (type == IN::CPL) proc_cpl();
+    else if constexpr (type == IN::SCF) proc_scf();
+    else if constexpr (type == IN::CCF) proc_ccf();
+    else if constexpr (type == IN::EI) proc_ei();
+    else if constexpr (type == IN::RETI) proc_reti();
+    else static_assert(type != type, "instruction type has no handler");
+}
+
+// One handler per opcode, specialized on everything the table says about it.
+template<IN type, AM mode, RT r1, RT r2, CT cond, u8 param, bool prefetched>
+void gbCpu::op_handler(gbCpu& cpu) {
+    cpu.decode_mode<mode, r1, r2, prefetched>();
+    cpu.execute_type<type, mode, r1, r2, cond, param>();
+}
+
+template<u8 op>
+void gbCpu::cb_handler(gbCpu& cpu) {
+    cpu.proc_cb_op<op>();
+}
+
+void gbCpu::op_illegal(gbCpu& cpu) {
+    std::ostringstream msg;
+    msg << "Instruction not implemented, opcode: 0x" << hex << static_cast<int>(cpu.opcode) << " PC: " << cpu.regs.pc << "\n";
+    cerr << msg.str();
+    cpu.stopped = true;
+}
+
+template<u8 op, bool prefetched>
+void gbCpu::exec_op(gbCpu& cpu) {
+    constexpr const InstructionData& ins = INSTRUCTION_TABLE[op];
+    if constexpr (ins.type == IN::ERR) op_illegal(cpu);
+    else op_handler<ins.type, ins.mode, ins.reg_1, ins.reg_2, ins.cond, ins.param, prefetched>(cpu);
+}
+
+// The threaded interpreter calls these directly, one label per opcode.
+#define ZB_EXEC_OP(h, l) \
+    template void gbCpu::exec_op<0x##h##l, false>(gbCpu&); \
+    template void gbCpu::exec_op<0x##h##l, true>(gbCpu&);
+ZB_OPCODES(ZB_EXEC_OP)
+#undef ZB_EXEC_OP
+
+template<u8 op>
+constexpr DispatchEntry gbCpu::make_dispatch_entry() {
+    constexpr const InstructionData& ins = INSTRUCTION_TABLE[op];
+    if constexpr (ins.type == IN::ERR) {
+        return DispatchEntry{&gbCpu::op_illegal, &gbCpu::op_illegal, nullptr, 1, 0};
+    } else {
+        return DispatchEntry{
+            &gbCpu::op_handler<ins.type, ins.mode, ins.reg_1, ins.reg_2, ins.cond, ins.param, false>,
+            &gbCpu::op_handler<ins.type, ins.mode, ins.reg_1, ins.reg_2, ins.cond, ins.param, true>,
+            &ins, static_cast<u8>(1 + inst_operand_bytes(ins.mode)), ins.cycles};
     }
-}
\ No newline at end of file
+}
+
+template<std::size_t... I>
+constexpr std::array<DispatchEntry, sizeof...(I)> gbCpu::make_dispatch(std::index_sequence<I...>) {
+    return {{ make_dispatch_entry<static_cast<u8>(I)>()... }};
+}
+
+template<std::size_t... I>
+constexpr std::array<OpHandler, sizeof...(I)> gbCpu::make_cb_handlers(std::index_sequence<I...>) {
+    return {{ &gbCpu::cb_handler<static_cast<u8>(I)>... }};
+}
+
+const std::array<OpHandler, 256> gbCpu::cb_dispatch = gbCpu::make_cb_handlers(std::make_index_sequence<256>{});
+
+const std::array<DispatchEntry, 256> gbCpu::dispatch = gbCpu::make_dispatch(std::make_index_sequence<256>{});
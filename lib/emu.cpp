@@ -1,33 +1,94 @@
 #include <iostream>
 
-#include "../headers/cart.hpp"
 #include "../headers/emu.hpp"
-#include "../headers/bus.hpp"
-#include "../headers/timer.hpp"
-#include "../headers/cpu.hpp"
-#include "../headers/instructions.hpp"
-
-int Emulator::run_emu(bool debug){
-    Timer timer;
-    Cart cart;
-    cart.read_rom("../../roms/02-interrupts.gb");
-
-    Bus bus = Bus(cart, &timer, nullptr);    // Create Bus
-    Instructions instr = Instructions();     // Create Instructions
-
-    gbCpu cpu(bus, instr, timer); // Pass pointers
-    timer.set_cpu(&cpu);
-    bus.set_cpu(&cpu);
-
-    int i=0;
-    while(true){
-        if (!cpu.step()) {
-            std::cout<<("CPU Stopped\n");
-            return 0;
+#include "../headers/save_state.hpp"
+
+// Instructions executed per gbCpu::run call before returning to this loop.
+static const int RUN_SLICE = 4096;
+
+const char* exit_reason_name(ExitReason reason) {
+    switch (reason) {
+        case ExitReason::BUDGET: return "budget";
+        case ExitReason::PASSED: return "passed";
+        case ExitReason::FAILED: return "failed";
+        case ExitReason::STOPPED: return "stopped";
+        case ExitReason::LOAD_FAILED: return "load failed";
+    }
+    return "unknown";
+}
+
+Emulator::Emulator(TraceLevel trace_level) : trace(trace_level) {}
+
+bool Emulator::load(const std::string& path) {
+    if (cart.read_rom(path) != 0) {
+        return false;
+    }
+
+    bus = std::make_unique<Bus>(cart, &timer, nullptr);
+    cpu = std::make_unique<gbCpu>(*bus, timer, sched);
+    timer.set_cpu(cpu.get());
+    timer.set_scheduler(&sched);
+    bus->set_cpu(cpu.get());
+    bus->set_scheduler(&sched);
+    bus->set_trace(&trace);
+    cpu->set_trace(&trace);
+    return true;
+}
+
+// Test ROMs print their verdict over the serial port, so the serial text is
+// checked between slices.
+ExitReason Emulator::run(u64 max_cycles) {
+    if (!cpu) {
+        return ExitReason::LOAD_FAILED;
+    }
+    size_t checked = 0;
+    while (sched.now() < max_cycles) {
+        // A halted step can take up to a frame; shrink the slice near the
+        // end so the budget is overshot by at most that.
+        u64 frames_left = (max_cycles - sched.now()) / FRAME_CYCLES + 1;
+        int slice = frames_left < RUN_SLICE ? static_cast<int>(frames_left) : RUN_SLICE;
+        if (rewind) {
+            rewind->update(*cpu, *bus, timer, sched);
         }
-        timer.timer_tick();
-        i+=1;
+        if (!cpu->run(slice)) {
+            return ExitReason::STOPPED;
+        }
+        const std::string& serial = bus->serial_text();
+        if (serial.size() != checked) {
+            size_t from = checked > 6 ? checked - 6 : 0;
+            checked = serial.size();
+            if (serial.find("Passed", from) != std::string::npos) {
+                return ExitReason::PASSED;
+            }
+            if (serial.find("Failed", from) != std::string::npos) {
+                return ExitReason::FAILED;
+            }
+        }
+    }
+    return ExitReason::BUDGET;
+}
+
+void Emulator::save_state(std::vector<u8>& out) const {
+    out.clear();
+    if (cpu) {
+        ::save_state(*cpu, *bus, timer, sched, out);
+    }
+}
+
+bool Emulator::load_state(const std::vector<u8>& in) {
+    return cpu && ::load_state(*cpu, *bus, timer, sched, in);
+}
+
+bool Emulator::step_back(u32 count) {
+    return cpu && rewind && rewind->step_back(count, *cpu, *bus, timer, sched);
+}
+
+int Emulator::run_emu(const std::string& path){
+    if (!load(path)) {
+        return 1;
+    }
+    if (run(Scheduler::NEVER) == ExitReason::STOPPED) {
+        std::cout<<("CPU Stopped\n");
     }
-    
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,166 @@
+#include <algorithm>
+
+#include "../headers/cpu.hpp"
+#include "../headers/bus.hpp"
+
+// Busy-wait loops such as LDH A,(n) / CP n / JR NZ polling IF, or a JR -2
+// spin waiting for an interrupt, cannot leave the state they are in until a
+// scheduled event fires. Once the CPU gets back to the head of such a loop
+// in the same state as one iteration earlier, the iterations left before
+// the next event are skipped, like HALT does.
+
+// Longest loop body, closing jump included, that is checked.
+static const u16 IDLE_LOOP_MAX_BYTES = 16;
+
+// Whether a read of address gives the same value every iteration. LY and
+// STAT do until the LCD's next line or mode change, so the loop's skip is
+// limited by that too; reads of more than two such places are not worth it.
+bool gbCpu::is_idle_read(u16 address) {
+    u64 now = sched.now();
+    u64 until = bus.read_stable_until(address, now);
+    if (until == now) {
+        return false;
+    }
+    if (until != Scheduler::NEVER) {
+        if (idle.timed_count == 2) {
+            return false;
+        }
+        idle.timed[idle.timed_count++] = address;
+    }
+    return true;
+}
+
+// Whether the instruction at pc only loads or compares registers and memory
+// that stays put between events.
+bool gbCpu::is_idle_op(u16 pc, const InstructionData& ins) {
+    switch (ins.type) {
+        case IN::NOP:
+            return true;
+        case IN::CB: {
+            u8 op = bus.read(pc + 1);
+            bool is_bit = op >= 0x40 && op < 0x80;
+            return is_bit && ((op & 0x07) != 0x06 || is_idle_read(regs.hl));
+        }
+        case IN::LD:
+        case IN::LDH:
+        case IN::AND:
+        case IN::OR:
+        case IN::XOR:
+        case IN::CP:
+        case IN::ADD:
+        case IN::ADC:
+        case IN::SUB:
+        case IN::SBC:
+            break;
+        default:
+            return false;
+    }
+
+    switch (ins.mode) {
+        case AM::R:
+        case AM::R_R:
+        case AM::R_D8:
+        case AM::R_D16:
+        case AM::HL_SPR:
+            return true;
+        case AM::R_MR: {
+            u16 addr = regs.read_reg(ins.reg_2);
+            if (ins.reg_2 == RT::C) addr |= 0xFF00;
+            return is_idle_read(addr);
+        }
+        case AM::R_A8:
+            return is_idle_read(0xFF00 | bus.read(pc + 1));
+        case AM::R_A16:
+            return is_idle_read(bus.read16(pc + 1));
+        default:
+            return false;
+    }
+}
+
+// M-cycles of one iteration of the loop [head, end), or 0 unless every
+// instruction is an idle op and the last one jumps back to head. Also
+// counts the iteration's instructions into idle.ops.
+u32 gbCpu::idle_loop_cycles(u16 head, u16 end) {
+    idle.timed_count = 0;
+    idle.ops = 0;
+    if (end <= head || end - head > IDLE_LOOP_MAX_BYTES) return 0;
+
+    u32 total = 0;
+    u16 pc = head;
+    while (pc < end) {
+        u8 op = bus.read(pc);
+        const DispatchEntry& entry = dispatch[op];
+        if (entry.ins == nullptr) return 0;
+        const InstructionData& ins = *entry.ins;
+        u16 next = pc + entry.length;
+
+        if (next == end) {
+            if ((ins.type != IN::JR && ins.type != IN::JP) || ins.mode == AM::R) return 0;
+            u16 target = ins.type == IN::JR ? static_cast<u16>(next + static_cast<s8>(bus.read(pc + 1)))
+                                            : bus.read16(pc + 1);
+            idle.ops++;
+            return target == head ? total + ins.cycles_taken : 0;
+        }
+        if (!is_idle_op(pc, ins)) return 0;
+        idle.ops++;
+        total += ins.type == IN::CB ? cb_cycles(bus.read(pc + 1)) : entry.cycles;
+        pc = next;
+    }
+    return 0;
+}
+
+// Called when the jump closing [head, end) is taken; `at` is the clock once
+// it completes. Returns the M-cycles of whole iterations that can be run
+// without reaching the next event, 0 if the loop is not idle. The skipped
+// iterations' instructions count as retired.
+u32 gbCpu::idle_skip(u16 head, u16 end, u64 at) {
+    if (idle.head != head || idle.end != end) {
+        idle = IdleLoop{};
+        idle.head = head;
+        idle.end = end;
+        idle.cycles = idle_loop_cycles(head, end);
+        idle.at = Scheduler::NEVER;
+    }
+    if (idle.cycles == 0) return 0;
+
+    // Same state as one iteration ago, with no event or interrupt in
+    // between: every iteration until the next event does the same.
+    u64 deadline = sched.next_deadline();
+    u16 af = regs.read_reg<RT::AF>();
+    bool repeated = idle.at + idle.cycles == at && idle.deadline == deadline &&
+                    idle.af == af && idle.bc == regs.bc && idle.de == regs.de &&
+                    idle.hl == regs.hl && idle.sp == regs.sp;
+    if (!repeated) {
+        // Pointer registers or the code may have changed: check the body again.
+        idle.cycles = idle_loop_cycles(head, end);
+        idle.at = at;
+        idle.deadline = deadline;
+        idle.af = af;
+        idle.bc = regs.bc;
+        idle.de = regs.de;
+        idle.hl = regs.hl;
+        idle.sp = regs.sp;
+        return 0;
+    }
+
+    // An interrupt is about to be taken.
+    if ((interupt_en || enabling_ime) && (int_flags & ie_register & 0x1F)) return 0;
+
+    u64 room = HALT_IDLE_CYCLES;
+    if (deadline <= at) {
+        return 0;
+    } else if (deadline != Scheduler::NEVER) {
+        room = std::min<u64>(room, deadline - 1 - at);
+    }
+    // The last iteration, starting at at - cycles, read LY or STAT; the
+    // skipped ones must read them before they next change.
+    for (u8 i = 0; i < idle.timed_count; i++) {
+        u64 until = bus.read_stable_until(idle.timed[i], at - idle.cycles);
+        if (until <= at) return 0;
+        room = std::min<u64>(room, until - 1 - at);
+    }
+    u32 skip = static_cast<u32>(room / idle.cycles * idle.cycles);
+    idle.at = at + skip;
+    retired += skip / idle.cycles * idle.ops;
+    return skip;
+}
@@ -0,0 +1,106 @@
+#include <iostream>
+
+#include "../headers/cpu.hpp"
+#include "../headers/timer.hpp"
+
+// gbCpu::run executes `count` instructions exactly like `count` calls to
+// step(): each one advances the scheduler clock by its cycle count before
+// interrupts are checked.
+//
+// With ZENBOY_THREADED_INTERPRETER on GCC/Clang the loop is direct-threaded:
+// every opcode has its own label that calls that opcode's handler directly
+// and ends with its own `goto *`, so the host predicts the next opcode per
+// instruction instead of through one shared indirect branch.
+//
+// With ZENBOY_JIT, hot blocks run their native translation (see Jit) in place
+// of the instructions it covers.
+
+#if defined(ZENBOY_THREADED_INTERPRETER) && (defined(__GNUC__) || defined(__clang__))
+
+#define ZB_LABEL_ADDR(h, l) &&op_##h##l,
+
+#ifdef ZENBOY_JIT
+#define ZB_TRY_NATIVE()                                 \
+    do {                                                \
+        int native = run_native(count);                 \
+        if (native > 0) {                               \
+            count -= native;                            \
+            if (count <= 0) return true;                \
+            goto fetch_next;                            \
+        }                                               \
+    } while (0)
+#else
+#define ZB_TRY_NATIVE() do {} while (0)
+#endif
+
+// Fetch and dispatch of the next instruction. Mirrors gbCpu::step().
+#define ZB_FETCH()                      \
+    do {                                \
+        if (halted) goto halted_step;   \
+        ZB_TRY_NATIVE();                \
+        mem_dest = 0;                   \
+        trace_instruction();            \
+        prefetched = fetch_ins();       \
+        retired++;                      \
+        goto *labels[opcode];           \
+    } while (0)
+
+// Epilogue of the previous instruction followed by the next one.
+#define ZB_NEXT()                       \
+    do {                                \
+        sched.advance(cycles);          \
+        update_ime();                   \
+        if (stopped) return false;      \
+        if (--count <= 0) return true;  \
+        ZB_FETCH();                     \
+    } while (0)
+
+#define ZB_OP(h, l)                                                 \
+    op_##h##l:                                                      \
+    if (prefetched) exec_op<0x##h##l, true>(*this);                 \
+    else exec_op<0x##h##l, false>(*this);                           \
+    ZB_NEXT();
+
+bool gbCpu::run(int count) {
+    static void* const labels[256] = { ZB_OPCODES(ZB_LABEL_ADDR) };
+    bool prefetched;
+
+    if (count <= 0) return true;
+
+#ifdef ZENBOY_JIT
+fetch_next:
+#endif
+    ZB_FETCH();
+
+halted_step:
+    cycles = halted_cycles();
+    ZB_NEXT();
+
+    ZB_OPCODES(ZB_OP)
+}
+
+#undef ZB_OP
+#undef ZB_NEXT
+#undef ZB_FETCH
+#undef ZB_TRY_NATIVE
+#undef ZB_LABEL_ADDR
+
+#else
+
+bool gbCpu::run(int count) {
+    for (int i = 0; i < count; i++) {
+#ifdef ZENBOY_JIT
+        if (!halted) {
+            int native = run_native(count - i);
+            if (native > 0) {
+                i += native - 1;
+                continue;
+            }
+        }
+#endif
+        if (!step()) return false;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,379 @@
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "../headers/jit.hpp"
+#include "../headers/cpu.hpp"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+
+#include <sys/mman.h>
+
+static const size_t JIT_BUFFER_SIZE = 1 << 20;
+
+// Worst case bytes emitted for one translated instruction.
+static const size_t MAX_OP_BYTES = 64;
+
+namespace {
+
+enum {
+    OFF_A = offsetof(gbRegisters, a),
+    OFF_F = offsetof(gbRegisters, f),
+    OFF_B = offsetof(gbRegisters, b),
+    OFF_C = offsetof(gbRegisters, c),
+    OFF_D = offsetof(gbRegisters, d),
+    OFF_E = offsetof(gbRegisters, e),
+    OFF_H = offsetof(gbRegisters, h),
+    OFF_L = offsetof(gbRegisters, l),
+    OFF_BC = offsetof(gbRegisters, bc),
+    OFF_DE = offsetof(gbRegisters, de),
+    OFF_HL = offsetof(gbRegisters, hl),
+    OFF_PC = offsetof(gbRegisters, pc),
+    OFF_SP = offsetof(gbRegisters, sp)
+};
+
+// GB flag bits in F
+enum { FLAG_Z = 0x80, FLAG_N = 0x40, FLAG_H = 0x20, FLAG_C = 0x10 };
+
+// Host flags as loaded into AH by LAHF
+enum { HOST_ZF = 0x40, HOST_AF = 0x10, HOST_CF = 0x01 };
+
+int reg8_offset(RT reg) {
+    switch (reg) {
+        case RT::A: return OFF_A;
+        case RT::B: return OFF_B;
+        case RT::C: return OFF_C;
+        case RT::D: return OFF_D;
+        case RT::E: return OFF_E;
+        case RT::H: return OFF_H;
+        case RT::L: return OFF_L;
+        default: return -1;
+    }
+}
+
+// Offset of a register pair as a host-order u16.
+int pair_offset(RT reg) {
+    switch (reg) {
+        case RT::BC: return OFF_BC;
+        case RT::DE: return OFF_DE;
+        case RT::HL: return OFF_HL;
+        default: return -1;
+    }
+}
+
+// Minimal encoder; every memory operand is [rdi + disp8] with rdi = &regs.
+class Emitter {
+    public:
+        explicit Emitter(u8* out) : out(out), start(out) {}
+
+        size_t size() const { return out - start; }
+        u8* here() const { return out; }
+
+        void byte(u8 b) { *out++ = b; }
+        void bytes(std::initializer_list<u8> list) { for (u8 b : list) byte(b); }
+        void imm16(u16 v) { byte(v & 0xFF); byte(v >> 8); }
+        void imm32(u32 v) { imm16(v & 0xFFFF); imm16(v >> 16); }
+
+        void movzx_eax_m16(int off) { bytes({0x0F, 0xB7, 0x47, (u8)off}); }
+        void movzx_ecx_m8(int off) { bytes({0x0F, 0xB6, 0x4F, (u8)off}); }
+        void mov_al_m8(int off) { bytes({0x8A, 0x47, (u8)off}); }
+        void mov_m8_al(int off) { bytes({0x88, 0x47, (u8)off}); }
+        void mov_m8_dl(int off) { bytes({0x88, 0x57, (u8)off}); }
+        void mov_m8_imm(int off, u8 v) { bytes({0xC6, 0x47, (u8)off, v}); }
+        void mov_m16_imm(int off, u16 v) { bytes({0x66, 0xC7, 0x47, (u8)off}); imm16(v); }
+        void mov_m16_ax(int off) { bytes({0x66, 0x89, 0x47, (u8)off}); }
+        void inc_m16(int off) { bytes({0x66, 0xFF, 0x47, (u8)off}); }
+        void dec_m16(int off) { bytes({0x66, 0xFF, 0x4F, (u8)off}); }
+        void inc_al() { bytes({0xFE, 0xC0}); }
+        void dec_al() { bytes({0xFE, 0xC8}); }
+        void not_al() { bytes({0xF6, 0xD0}); }
+        // op al, [rdi+off] / op al, imm8 for ADD, SUB, AND, XOR, OR, CP
+        void alu_al_m8(u8 opcode_rm, int off) { bytes({opcode_rm, 0x47, (u8)off}); }
+        void alu_al_imm(u8 opcode_imm, u8 v) { bytes({opcode_imm, v}); }
+        void and_m8_imm(int off, u8 v) { bytes({0x80, 0x67, (u8)off, v}); }
+        void or_m8_imm(int off, u8 v) { bytes({0x80, 0x4F, (u8)off, v}); }
+        void xor_m8_imm(int off, u8 v) { bytes({0x80, 0x77, (u8)off, v}); }
+        void test_m8_imm(int off, u8 v) { bytes({0xF6, 0x47, (u8)off, v}); }
+        void lahf() { byte(0x9F); }
+        void mov_eax_imm(u32 v) { byte(0xB8); imm32(v); }
+        void ret() { byte(0xC3); }
+
+        // jz/jnz rel8 with the displacement patched by bind()
+        u8* jcc8(bool if_zero) { bytes({(u8)(if_zero ? 0x74 : 0x75), 0x00}); return out - 1; }
+        void bind(u8* disp) { *disp = static_cast<u8>(out - (disp + 1)); }
+
+        // F = host Z/H/C picked by `from_host` | `set` | (old F & `keep`).
+        // Expects the host flags of the ALU op in AH (after LAHF).
+        void store_flags(u8 from_host, u8 set, u8 keep) {
+            bytes({0x0F, 0xB6, 0xCC});                              // movzx ecx, ah
+            bytes({0x31, 0xD2});                                    // xor edx, edx
+            if (from_host & FLAG_Z) {
+                bytes({0x89, 0xCE, 0x83, 0xE6, HOST_ZF, 0xD1, 0xE6, 0x09, 0xF2});   // edx |= (ecx & ZF) << 1
+            }
+            if (from_host & FLAG_H) {
+                bytes({0x89, 0xCE, 0x83, 0xE6, HOST_AF, 0xD1, 0xE6, 0x09, 0xF2});   // edx |= (ecx & AF) << 1
+            }
+            if (from_host & FLAG_C) {
+                bytes({0x83, 0xE1, HOST_CF, 0xC1, 0xE1, 0x04, 0x09, 0xCA});         // edx |= (ecx & CF) << 4
+            }
+            if (set) {
+                bytes({0x80, 0xCA, set});                           // or dl, set
+            }
+            if (keep) {
+                movzx_ecx_m8(OFF_F);
+                bytes({0x83, 0xE1, keep, 0x09, 0xCA});              // edx |= F & keep
+            }
+            mov_m8_dl(OFF_F);
+        }
+
+    private:
+        u8* out;
+        u8* start;
+};
+
+// Low nibble of F is never touched by the interpreter; keep it as is.
+const u8 KEEP_LOW = 0x0F;
+
+bool translatable(const InstructionData& ins) {
+    switch (ins.type) {
+        case IN::NOP:
+        case IN::CPL:
+        case IN::SCF:
+        case IN::CCF:
+            return true;
+        case IN::LD:
+            if (ins.mode == AM::R_R) {
+                return (reg8_offset(ins.reg_1) >= 0 && reg8_offset(ins.reg_2) >= 0) ||
+                       (ins.reg_1 == RT::SP && ins.reg_2 == RT::HL);
+            }
+            if (ins.mode == AM::R_D8) return reg8_offset(ins.reg_1) >= 0;
+            if (ins.mode == AM::R_D16) return pair_offset(ins.reg_1) >= 0 || ins.reg_1 == RT::SP;
+            return false;
+        case IN::INC:
+        case IN::DEC:
+            return ins.mode == AM::R &&
+                   (reg8_offset(ins.reg_1) >= 0 || pair_offset(ins.reg_1) >= 0 || ins.reg_1 == RT::SP);
+        case IN::ADD:
+        case IN::SUB:
+        case IN::AND:
+        case IN::XOR:
+        case IN::OR:
+        case IN::CP:
+            if (ins.reg_1 != RT::A) return false;
+            return ins.mode == AM::R_D8 || (ins.mode == AM::R_R && reg8_offset(ins.reg_2) >= 0);
+        case IN::JR:
+            return ins.mode == AM::D8;
+        case IN::JP:
+            return ins.mode == AM::D16 || (ins.mode == AM::R && ins.reg_1 == RT::HL);
+        default:
+            return false;
+    }
+}
+
+// Emits the PC update and return for the end of the translated prefix.
+void emit_exit(Emitter& e, u16 pc, u32 cycles) {
+    e.mov_m16_imm(OFF_PC, pc);
+    e.mov_eax_imm(cycles);
+    e.ret();
+}
+
+// JP/JR: the last translated op, `cycles` spent before it. Condition flags
+// are read from F.
+void emit_branch(Emitter& e, const MicroOp& op, u32 cycles) {
+    const InstructionData& ins = *op.ins;
+    u16 next = op.pc + op.length;
+
+    if (ins.mode == AM::R) { // JP HL
+        e.movzx_eax_m16(OFF_HL);
+        e.mov_m16_ax(OFF_PC);
+        e.mov_eax_imm(cycles + ins.cycles_taken);
+        e.ret();
+        return;
+    }
+
+    u16 target = ins.type == IN::JR ? static_cast<u16>(next + static_cast<s8>(op.imm & 0xFF)) : op.imm;
+    if (ins.cond == CT::NONE) {
+        emit_exit(e, target, cycles + ins.cycles_taken);
+        return;
+    }
+    u8 mask = (ins.cond == CT::Z || ins.cond == CT::NZ) ? FLAG_Z : FLAG_C;
+    bool taken_if_set = ins.cond == CT::Z || ins.cond == CT::C;
+    e.test_m8_imm(OFF_F, mask);
+    u8* not_taken = e.jcc8(taken_if_set); // skip when flag clear (Z/C) or set (NZ/NC)
+    emit_exit(e, target, cycles + ins.cycles_taken);
+    e.bind(not_taken);
+    emit_exit(e, next, cycles + ins.cycles);
+}
+
+void emit_op(Emitter& e, const MicroOp& op) {
+    const InstructionData& ins = *op.ins;
+    switch (ins.type) {
+        case IN::NOP:
+            break;
+        case IN::CPL:
+            e.xor_m8_imm(OFF_A, 0xFF);
+            e.or_m8_imm(OFF_F, FLAG_N | FLAG_H);
+            break;
+        case IN::SCF:
+            e.and_m8_imm(OFF_F, FLAG_Z | KEEP_LOW);
+            e.or_m8_imm(OFF_F, FLAG_C);
+            break;
+        case IN::CCF:
+            e.xor_m8_imm(OFF_F, FLAG_C);
+            e.and_m8_imm(OFF_F, FLAG_Z | FLAG_C | KEEP_LOW);
+            break;
+        case IN::LD:
+            if (ins.mode == AM::R_R && ins.reg_1 == RT::SP) {
+                e.movzx_eax_m16(OFF_HL);
+                e.mov_m16_ax(OFF_SP);
+            } else if (ins.mode == AM::R_R) {
+                e.mov_al_m8(reg8_offset(ins.reg_2));
+                e.mov_m8_al(reg8_offset(ins.reg_1));
+            } else if (ins.mode == AM::R_D8) {
+                e.mov_m8_imm(reg8_offset(ins.reg_1), op.imm & 0xFF);
+            } else if (ins.reg_1 == RT::SP) {
+                e.mov_m16_imm(OFF_SP, op.imm);
+            } else {
+                e.mov_m16_imm(pair_offset(ins.reg_1), op.imm);
+            }
+            break;
+        case IN::INC:
+        case IN::DEC: {
+            bool inc = ins.type == IN::INC;
+            if (ins.reg_1 == RT::SP || pair_offset(ins.reg_1) >= 0) {
+                int off = ins.reg_1 == RT::SP ? OFF_SP : pair_offset(ins.reg_1);
+                if (inc) e.inc_m16(off); else e.dec_m16(off);
+            } else {
+                int off = reg8_offset(ins.reg_1);
+                e.mov_al_m8(off);
+                if (inc) e.inc_al(); else e.dec_al();
+                e.lahf();
+                e.mov_m8_al(off);
+                e.store_flags(FLAG_Z | FLAG_H, inc ? 0 : FLAG_N, FLAG_C | KEEP_LOW);
+            }
+            break;
+        }
+        default: { // ALU A, r / A, d8
+            u8 rm_op = 0, imm_op = 0;
+            switch (ins.type) {
+                case IN::ADD: rm_op = 0x02; imm_op = 0x04; break;
+                case IN::OR:  rm_op = 0x0A; imm_op = 0x0C; break;
+                case IN::AND: rm_op = 0x22; imm_op = 0x24; break;
+                case IN::SUB: rm_op = 0x2A; imm_op = 0x2C; break;
+                case IN::XOR: rm_op = 0x32; imm_op = 0x34; break;
+                default:      rm_op = 0x3A; imm_op = 0x3C; break; // CP
+            }
+            e.mov_al_m8(OFF_A);
+            if (ins.mode == AM::R_D8) e.alu_al_imm(imm_op, op.imm & 0xFF);
+            else e.alu_al_m8(rm_op, reg8_offset(ins.reg_2));
+            e.lahf();
+            if (ins.type != IN::CP) e.mov_m8_al(OFF_A);
+            switch (ins.type) {
+                case IN::ADD: e.store_flags(FLAG_Z | FLAG_H | FLAG_C, 0, KEEP_LOW); break;
+                case IN::SUB:
+                case IN::CP:  e.store_flags(FLAG_Z | FLAG_H | FLAG_C, FLAG_N, KEEP_LOW); break;
+                case IN::AND: e.store_flags(FLAG_Z, FLAG_H, KEEP_LOW); break;
+                default:      e.store_flags(FLAG_Z, 0, KEEP_LOW); break; // XOR, OR
+            }
+            break;
+        }
+    }
+}
+
+// The code buffer is never writable and executable at once: it is RX while
+// translations run and goes RW only while compile() emits into it.
+static bool set_writable(u8* buffer, size_t size, bool writable) {
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+    return mprotect(buffer, size, prot) == 0;
+}
+
+} // namespace
+
+Jit::Jit() {
+    void* mem = mmap(nullptr, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return;
+    // Hosts that refuse executable mappings get no JIT.
+    if (!set_writable(static_cast<u8*>(mem), JIT_BUFFER_SIZE, false)) {
+        munmap(mem, JIT_BUFFER_SIZE);
+        return;
+    }
+    buffer = static_cast<u8*>(mem);
+    capacity = JIT_BUFFER_SIZE;
+}
+
+Jit::~Jit() {
+    if (buffer) {
+        munmap(buffer, capacity);
+    }
+}
+
+bool Jit::compile(Block& block) {
+    block.native = nullptr;
+    block.native_epoch = code_epoch;
+    if (!available()) return false;
+
+    size_t count = 0;
+    while (count < block.ops.size() && translatable(*block.ops[count].ins)) {
+        IN type = block.ops[count].ins->type;
+        count++;
+        if (type == IN::JR || type == IN::JP) break;
+    }
+    if (count < MIN_OPS) return false;
+
+    if (capacity - used < count * MAX_OP_BYTES + MAX_OP_BYTES) {
+        // Out of space: recycle the buffer. Blocks compiled in the previous
+        // epoch see the mismatch and get translated again when hot.
+        used = 0;
+        code_epoch++;
+    }
+
+    if (!set_writable(buffer, capacity, true)) return false;
+    Emitter e(buffer + used);
+    u32 cycles = 0;
+    for (size_t i = 0; i < count; i++) {
+        const MicroOp& op = block.ops[i];
+        IN type = op.ins->type;
+        if (type == IN::JR || type == IN::JP) {
+            emit_branch(e, op, cycles);
+            cycles += op.ins->cycles_taken;
+        } else {
+            emit_op(e, op);
+            cycles += op.ins->cycles;
+        }
+    }
+    IN last = block.ops[count - 1].ins->type;
+    if (last != IN::JR && last != IN::JP) {
+        const MicroOp& op = block.ops[count - 1];
+        emit_exit(e, op.pc + op.length, cycles);
+    }
+    if (!set_writable(buffer, capacity, false)) {
+        // Code that cannot be made executable again is unusable, as is
+        // everything compiled before it.
+        munmap(buffer, capacity);
+        buffer = nullptr;
+        code_epoch++;
+        return false;
+    }
+
+    block.native = buffer + used;
+    block.native_epoch = code_epoch;
+    block.native_ops = static_cast<u8>(count);
+    block.native_cycles = static_cast<u16>(cycles);
+    used += e.size();
+    return true;
+}
+
+#else
+
+Jit::Jit() {}
+
+Jit::~Jit() {}
+
+bool Jit::compile(Block& block) {
+    block.native = nullptr;
+    block.native_epoch = code_epoch;
+    return false;
+}
+
+#endif
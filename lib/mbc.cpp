@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include "../headers/mbc.hpp"
+
+// Cartridge type byte at 0x0147. Controllers without support run as plain
+// 32 KiB ROMs.
+MbcType mbc_type_for(u8 cart_type) {
+    switch (cart_type) {
+        case 0x00: case 0x08: case 0x09:
+            return MbcType::NONE;
+        case 0x01: case 0x02: case 0x03:
+            return MbcType::MBC1;
+        case 0x0F: case 0x10: case 0x11: case 0x12: case 0x13:
+            return MbcType::MBC3;
+        case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E:
+            return MbcType::MBC5;
+        default: {
+            // Formatted locally: std::hex on std::cerr would race with other instances.
+            std::ostringstream msg;
+            msg << "Warning: unsupported cartridge type 0x" << std::hex << static_cast<int>(cart_type)
+                << ", running without a memory bank controller\n";
+            std::cerr << msg.str();
+            return MbcType::NONE;
+        }
+    }
+}
+
+// RAM size byte at 0x0149.
+size_t cart_ram_size(u8 ram_size_code) {
+    switch (ram_size_code) {
+        case 0x02: return 0x2000;
+        case 0x03: return 0x8000;
+        case 0x04: return 0x20000;
+        case 0x05: return 0x10000;
+        default: return 0;
+    }
+}
+
+Mbc::Mbc(MbcType type, u32 rom_banks, u32 ram_banks)
+    : rom_banks(rom_banks ? rom_banks : 1), ram_banks(ram_banks ? ram_banks : 1), type(type) {
+    // Without a controller there is nothing to enable.
+    ram_enable = type == MbcType::NONE;
+}
+
+bool Mbc::write(u16 address, u8 value) {
+    u32 bank0 = rom_bank0();
+    u32 bank = rom_bank();
+    u32 ram = ram_bank();
+    bool ram_on = ram_mapped();
+    bool rtc_on = rtc_mapped();
+
+    switch (type) {
+        case MbcType::NONE:
+            return false;
+
+        case MbcType::MBC1:
+            if (address < 0x2000) {
+                ram_enable = (value & 0x0F) == 0x0A;
+            } else if (address < 0x4000) {
+                rom_select = value & 0x1F;
+            } else if (address < 0x6000) {
+                ram_select = value & 0x03;
+            } else {
+                mbc1_mode = value & 0x01;
+            }
+            break;
+
+        case MbcType::MBC3:
+            if (address < 0x2000) {
+                ram_enable = (value & 0x0F) == 0x0A;
+            } else if (address < 0x4000) {
+                rom_select = value & 0x7F;
+            } else if (address < 0x6000) {
+                ram_select = value;
+            } else {
+                // Writing 0 then 1 copies the clock into the readable registers.
+                if (latch_prev == 0x00 && value == 0x01) {
+                    std::copy(std::begin(rtc), std::end(rtc), std::begin(rtc_latched));
+                }
+                latch_prev = value;
+            }
+            break;
+
+        case MbcType::MBC5:
+            if (address < 0x2000) {
+                ram_enable = (value & 0x0F) == 0x0A;
+            } else if (address < 0x3000) {
+                rom_select = (rom_select & 0x100) | value;
+            } else if (address < 0x4000) {
+                rom_select = (rom_select & 0xFF) | ((value & 0x01) << 8);
+            } else if (address < 0x6000) {
+                ram_select = value & 0x0F;
+            }
+            break;
+    }
+
+    return bank0 != rom_bank0() || bank != rom_bank() || ram != ram_bank() ||
+           ram_on != ram_mapped() || rtc_on != rtc_mapped();
+}
+
+u32 Mbc::rom_bank0() const {
+    if (type == MbcType::MBC1 && mbc1_mode) {
+        return (static_cast<u32>(ram_select) << 5) % rom_banks;
+    }
+    return 0;
+}
+
+u32 Mbc::rom_bank() const {
+    u32 bank = rom_select;
+    switch (type) {
+        case MbcType::NONE:
+            return 1;
+        case MbcType::MBC1:
+            // Bank 0 in the low bits selects 1, also for 0x20, 0x40 and 0x60.
+            if (bank == 0) bank = 1;
+            bank |= static_cast<u32>(ram_select) << 5;
+            break;
+        case MbcType::MBC3:
+            if (bank == 0) bank = 1;
+            break;
+        case MbcType::MBC5:
+            break;
+    }
+    return bank % rom_banks;
+}
+
+u32 Mbc::ram_bank() const {
+    switch (type) {
+        case MbcType::MBC1:
+            return mbc1_mode ? ram_select % ram_banks : 0;
+        case MbcType::MBC3:
+        case MbcType::MBC5:
+            return (ram_select & 0x0F) % ram_banks;
+        default:
+            return 0;
+    }
+}
+
+bool Mbc::ram_mapped() const {
+    return ram_enable && !(type == MbcType::MBC3 && ram_select >= 0x08);
+}
+
+bool Mbc::rtc_mapped() const {
+    return type == MbcType::MBC3 && ram_enable && ram_select >= 0x08 && ram_select <= 0x0C;
+}
+
+u8 Mbc::rtc_read() const {
+    return rtc_latched[ram_select - 0x08];
+}
+
+void Mbc::rtc_write(u8 value) {
+    rtc[ram_select - 0x08] = value;
+    rtc_latched[ram_select - 0x08] = value;
+}
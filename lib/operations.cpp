@@ -3,7 +3,35 @@
 
 #include <iostream>
 
+void gbRegisters::materialize_flags() {
+    u8 z = (flag_res & 0xFF) == 0 ? 0x80 : 0;
+    switch (flag_op) {
+        case FlagOp::NONE:
+            return;
+        case FlagOp::ADD:
+            f = (f & 0x0F) | z | (((flag_lhs & 0xF) + (flag_rhs & 0xF)) > 0xF ? 0x20 : 0) | (flag_res > 0xFF ? 0x10 : 0);
+            break;
+        case FlagOp::SUB:
+            f = (f & 0x0F) | z | 0x40 | ((flag_lhs & 0xF) < (flag_rhs & 0xF) ? 0x20 : 0) | (flag_lhs < flag_rhs ? 0x10 : 0);
+            break;
+        case FlagOp::AND:
+            f = (f & 0x0F) | z | 0x20;
+            break;
+        case FlagOp::OR_XOR:
+            f = (f & 0x0F) | z;
+            break;
+        case FlagOp::INC:
+            f = (f & 0x1F) | z | ((flag_lhs & 0xF) == 0xF ? 0x20 : 0);
+            break;
+        case FlagOp::DEC:
+            f = (f & 0x1F) | z | 0x40 | ((flag_lhs & 0xF) == 0 ? 0x20 : 0);
+            break;
+    }
+    flag_op = FlagOp::NONE;
+}
+
 void gbRegisters::set_flag(char flag_char, bool value) {
+    materialize_flags();
     switch (flag_char) {
         case 'Z':
         case 'z':
@@ -27,18 +55,21 @@ void gbRegisters::set_flag(char flag_char, bool value) {
     }
 }
 void gbRegisters::toggle_flag(bool Z, bool N, bool H, bool C){
+    materialize_flags();
     if (Z==true) f ^= 1<<7;
     if (N==true) f ^= 1<<6;
     if (H==true) f ^= 1<<5;
     if (C==true) f ^= 1<<4;
 }
 void gbRegisters::clear_flag(bool Z,bool N,bool H,bool C){
+    materialize_flags();
     if (Z==true) f &= ~(1<<7);
     if (N==true) f &= ~(1<<6);
     if (H==true) f &= ~(1<<5);
     if (C==true) f &= ~(1<<4);
 }
 bool gbRegisters::read_flag(char flag){
+    materialize_flags();
     switch(flag){
         case 'Z': return (f>>7)&1;
         case 'N': return (f>>6)&1;
@@ -47,61 +78,6 @@ bool gbRegisters::read_flag(char flag){
     }
     return 0;
 }
-u16 gbRegisters::read_reg(RT reg){
-    switch(reg){
-        case RT::A: return a;        
-        case RT::B: return b;
-        case RT::C: return c;
-        case RT::D: return d;
-        case RT::E: return e;
-        case RT::H: return h;
-        case RT::L: return l;
-        case RT::AF: return (a << 8)|f;
-        case RT::BC: return (b << 8)|c;
-        case RT::DE: return (d << 8)|e;
-        case RT::HL: return (h << 8)|l;
-        case RT::SP: return sp;
-        default: 
-            std::invalid_argument("Invalid register");
-            exit(-4);
-            return 0;
-    }
-}
-
-void gbRegisters::set_reg(RT reg, uint16_t value) {
-    switch (reg) {
-        case RT::A:  a = static_cast<uint8_t>(value); break; // Cast to 8-bit
-        case RT::B:  b = static_cast<uint8_t>(value); break;
-        case RT::C:  c = static_cast<uint8_t>(value); break;
-        case RT::D:  d = static_cast<uint8_t>(value); break;
-        case RT::E:  e = static_cast<uint8_t>(value); break;
-        case RT::H:  h = static_cast<uint8_t>(value); break;
-        case RT::L:  l = static_cast<uint8_t>(value); break;
-        case RT::AF:
-            a = static_cast<uint8_t>(value >> 8); // High byte
-            f = static_cast<uint8_t>(value & 0xFF); // Low byte
-            break;
-        case RT::BC:
-            b = static_cast<uint8_t>(value >> 8);
-            c = static_cast<uint8_t>(value & 0xFF);
-            break;
-        case RT::DE:
-            d = static_cast<uint8_t>(value >> 8);
-            e = static_cast<uint8_t>(value & 0xFF);
-            break;
-        case RT::HL:
-            h = static_cast<uint8_t>(value >> 8);
-            l = static_cast<uint8_t>(value & 0xFF);
-            break;
-        case RT::SP: sp = value; break;
-        case RT::PC: pc = value; break;
-        default:
-            // Same error handling as in read_reg
-            std::invalid_argument("Invalid register");
-            break;
-    }
-}
-
 std::string gbRegisters::Register_by_Name(RT reg){
     switch (reg) {
         case RT::A: return "A";
@@ -149,6 +125,7 @@ void gbCpu::set_ie_register(uint8_t value) {
 void gbCpu::int_handle( u16 address) {
     stack_push16(regs.pc);
     regs.pc = address;
+    sched.advance(5); // interrupt dispatch takes 5 M-cycles
 }
 
 bool gbCpu::int_check(u16 address, interrupt_type it) {
@@ -187,14 +164,42 @@ void gbCpu::set_int_flags(u8 value){
     int_flags = value;
 }
 
-void gbCpu::dbg_update(){
-    if (bus.read(0xFF02) == 0x81) {
-        char c = bus.read(0xFF01);
-        dbg_msg[msg_size++] = c;
-        bus.write(0xFF02, 0);
+void gbCpu::set_trace(Trace* trace_ptr) {
+    trace = trace_ptr;
+}
+
+// Registers and interrupt state; save states are taken between
+// instructions, so nothing about the current instruction is kept.
+typedef struct {
+    u8 ie_register;
+    u8 int_flags;
+    bool interupt_en;
+    bool enabling_ime;
+    bool halted;
+} CpuState;
+
+size_t gbCpu::state_size() const {
+    return sizeof(gbRegisters) + sizeof(CpuState);
+}
+
+void gbCpu::save_state(StateWriter& out) const {
+    out.pod(regs);
+    out.pod(CpuState{ie_register, int_flags, interupt_en, enabling_ime, halted});
+}
+
+void gbCpu::load_state(StateReader& in) {
+    CpuState state;
+    if (!in.pod(regs) || !in.pod(state)) {
+        return;
     }
-};
-void gbCpu::dbg_print(){   
-    if (dbg_msg[0]) {
-    std::cerr<<"DBG:"<<dbg_msg<<std::endl;
-}};
\ No newline at end of file
+    ie_register = state.ie_register;
+    int_flags = state.int_flags;
+    interupt_en = state.interupt_en;
+    enabling_ime = state.enabling_ime;
+    halted = state.halted;
+    stopped = false;
+
+    cur_block = nullptr;
+    block_pos = 0;
+    idle = IdleLoop{};
+}
@@ -0,0 +1,340 @@
+#include <cstring>
+
+#include "../headers/ppu.hpp"
+#include "../headers/cpu.hpp"
+#include "../headers/scheduler.hpp"
+#include "../headers/save_state.hpp"
+
+Ppu::Ppu() {
+    std::memset(vram, 0, sizeof(vram));
+    std::memset(oam, 0, sizeof(oam));
+}
+
+void Ppu::vram_write(u16 offset, u8 value) {
+    vram[offset] = value;
+    forward(0x8000 + offset, value);
+}
+
+void Ppu::oam_write(u8 index, u8 value) {
+    oam[index] = value;
+    forward(0xFE00 + index, value);
+}
+
+// Skipped frames still pass writes on, so the renderer's copy is current
+// when the next drawn frame starts. With drawing off nothing is passed on
+// and the copy is rebuilt when it is turned back on. Lines due before the
+// write are drawn first, with what was there before.
+void Ppu::forward(u16 address, u8 value) {
+    if (interval) {
+        catch_up(now());
+        renderer.write(address, value);
+    }
+}
+
+void Ppu::set_render_interval(u32 frames) {
+    if (frames == interval) {
+        return;
+    }
+    if (interval == 0 && frames != 0) {
+        reset_renderer(0);
+        next_draw = first_draw_after(now());
+    }
+    interval = frames;
+}
+
+const u8* Ppu::framebuffer() {
+    catch_up(now());
+    renderer.flush();
+    return renderer.framebuffer();
+}
+
+void Ppu::set_cpu(gbCpu* cpu_ptr) {
+    cpu = cpu_ptr;
+}
+
+void Ppu::set_scheduler(Scheduler* sched_ptr) {
+    sched = sched_ptr;
+    sched->set_handler(EventType::PPU_VBLANK, &Ppu::on_vblank, this);
+    sched->set_handler(EventType::PPU_STAT, &Ppu::on_stat, this);
+    if (lcdc & 0x80) {
+        turn_on(sched->now());
+    }
+}
+
+u64 Ppu::now() const {
+    return sched ? sched->now() : 0;
+}
+
+// LY and the mode at cycle at. With the LCD off LY holds at 0 in mode 0.
+void Ppu::position(u64 at, u8& line, u8& mode) const {
+    if (!(lcdc & 0x80)) {
+        line = 0;
+        mode = MODE_HBLANK;
+        return;
+    }
+    u32 t = static_cast<u32>((at - origin) % FRAME_CYCLES);
+    u32 dot = t % LINE_CYCLES;
+    line = static_cast<u8>(t / LINE_CYCLES);
+    if (line >= VBLANK_LINE) {
+        mode = MODE_VBLANK;
+    } else if (dot < OAM_SCAN_CYCLES) {
+        mode = MODE_OAM_SCAN;
+    } else if (dot < OAM_SCAN_CYCLES + TRANSFER_CYCLES) {
+        mode = MODE_TRANSFER;
+    } else {
+        mode = MODE_HBLANK;
+    }
+}
+
+// The STAT interrupt line: any enabled source true. The interrupt is
+// requested when it rises.
+bool Ppu::stat_high(u64 at) const {
+    if (!(lcdc & 0x80)) {
+        return false;
+    }
+    u8 line, mode;
+    position(at, line, mode);
+    return ((stat & 0x40) && line == lyc) ||
+           ((stat & 0x20) && mode == MODE_OAM_SCAN) ||
+           ((stat & 0x10) && mode == MODE_VBLANK) ||
+           ((stat & 0x08) && mode == MODE_HBLANK);
+}
+
+// The first line start after from, or mode change unless lines_only.
+u64 Ppu::next_change(u64 from, bool lines_only) const {
+    u32 t = static_cast<u32>((from - origin) % FRAME_CYCLES);
+    u32 dot = t % LINE_CYCLES;
+    u32 next = LINE_CYCLES;
+    if (!lines_only && t / LINE_CYCLES < VBLANK_LINE) {
+        if (dot < OAM_SCAN_CYCLES) {
+            next = OAM_SCAN_CYCLES;
+        } else if (dot < OAM_SCAN_CYCLES + TRANSFER_CYCLES) {
+            next = OAM_SCAN_CYCLES + TRANSFER_CYCLES;
+        }
+    }
+    return from - dot + next;
+}
+
+u64 Ppu::stable_until(u16 address, u64 from) const {
+    if (!(lcdc & 0x80) || (address != 0xFF41 && address != 0xFF44)) {
+        return Scheduler::NEVER;
+    }
+    return next_change(from, address == 0xFF44);
+}
+
+// When line 0 of the first frame to start after at finishes its transfer.
+u64 Ppu::first_draw_after(u64 at) const {
+    u64 frames = (at - origin) / FRAME_CYCLES + 1;
+    return origin + frames * FRAME_CYCLES + OAM_SCAN_CYCLES + TRANSFER_CYCLES;
+}
+
+// Draws every line whose transfer mode ended by cycle at, with the
+// registers and VRAM as they are now. Anything that changes them calls
+// this first, and VBlank finishes the frame.
+void Ppu::catch_up(u64 at) {
+    if (!interval || !(lcdc & 0x80)) {
+        return;
+    }
+    while (next_draw <= at) {
+        u8 line = static_cast<u8>((next_draw - origin) % FRAME_CYCLES / LINE_CYCLES);
+        if (line == 0) {
+            drawing = frame_count % interval == 0;
+            if (drawing) {
+                renderer.start_frame();
+            }
+        }
+        if (drawing) {
+            renderer.draw_line(line);
+        }
+        next_draw += line == VBLANK_LINE - 1 ? (LINES_PER_FRAME - line) * LINE_CYCLES : LINE_CYCLES;
+    }
+}
+
+void Ppu::reset_renderer(u8 window) {
+    u8 regs[12];
+    for (u16 i = 0; i < 12; i++) {
+        regs[i] = read(0xFF40 + i);
+    }
+    renderer.reset(vram, oam, regs, window);
+}
+
+// Line 0 starts at cycle at.
+void Ppu::turn_on(u64 at) {
+    origin = at;
+    next_draw = at + OAM_SCAN_CYCLES + TRANSFER_CYCLES;
+    if (sched) {
+        sched->schedule(EventType::PPU_VBLANK, at + VBLANK_LINE * LINE_CYCLES);
+    }
+    stat_changed(false);
+}
+
+// After a write that can change the STAT line: it rising requests the
+// interrupt at once, and the next edge has moved.
+void Ppu::stat_changed(bool was_high) {
+    u64 at = now();
+    if (stat_high(at) && !was_high && cpu) {
+        cpu->request_interrupt(IT_LCD_STAT);
+    }
+    schedule_stat(at);
+}
+
+// Schedules the next rising edge of the STAT line after from. The line is
+// the same every frame, so a frame's worth of mode changes is enough to
+// find one if there is any.
+void Ppu::schedule_stat(u64 from) {
+    if (!sched) {
+        return;
+    }
+    if ((lcdc & 0x80) && (stat & 0x78)) {
+        bool high = stat_high(from);
+        u64 at = from;
+        for (u32 i = 0; i < 3u * LINES_PER_FRAME; i++) {
+            at = next_change(at, false);
+            bool now_high = stat_high(at);
+            if (now_high && !high) {
+                sched->schedule(EventType::PPU_STAT, at);
+                return;
+            }
+            high = now_high;
+        }
+    }
+    sched->cancel(EventType::PPU_STAT);
+}
+
+// Deadlines are chained from when, not from the current cycle, so late
+// handling never drifts the frame.
+void Ppu::on_vblank(void* ctx, u64 when) {
+    Ppu* ppu = static_cast<Ppu*>(ctx);
+    ppu->catch_up(when);
+    ppu->frame_count++;
+    if (ppu->cpu) {
+        ppu->cpu->request_interrupt(IT_VBLANK);
+    }
+    ppu->sched->schedule(EventType::PPU_VBLANK, when + FRAME_CYCLES);
+}
+
+void Ppu::on_stat(void* ctx, u64 when) {
+    Ppu* ppu = static_cast<Ppu*>(ctx);
+    if (ppu->cpu) {
+        ppu->cpu->request_interrupt(IT_LCD_STAT);
+    }
+    ppu->schedule_stat(when);
+}
+
+u8 Ppu::read(u16 address) const {
+    u8 line, mode;
+    switch (address) {
+        case 0xFF40: return lcdc;
+        case 0xFF41:
+            position(now(), line, mode);
+            return 0x80 | stat | (line == lyc ? 0x04 : 0x00) | mode;
+        case 0xFF42: return scy;
+        case 0xFF43: return scx;
+        case 0xFF44:
+            position(now(), line, mode);
+            return line;
+        case 0xFF45: return lyc;
+        case 0xFF46: return dma;
+        case 0xFF47: return bgp;
+        case 0xFF48: return obp0;
+        case 0xFF49: return obp1;
+        case 0xFF4A: return wy;
+        case 0xFF4B: return wx;
+    }
+    return 0xFF;
+}
+
+void Ppu::write(u16 address, u8 value) {
+    bool on = lcdc & 0x80;
+    bool was_high = (address == 0xFF41 || address == 0xFF45) && stat_high(now());
+    // The renderer needs the registers that change pixels, and the lines
+    // before this write drawn with the old value.
+    bool pixels = address == 0xFF40 || address == 0xFF42 || address == 0xFF43 || address >= 0xFF47;
+    if (pixels) {
+        catch_up(now());
+    }
+    switch (address) {
+        case 0xFF40:
+            lcdc = value;
+            if (on && !(value & 0x80)) {
+                // Off: LY holds at 0 in mode 0 until the LCD is turned on.
+                if (sched) {
+                    sched->cancel(EventType::PPU_VBLANK);
+                    sched->cancel(EventType::PPU_STAT);
+                }
+            } else if (!on && (value & 0x80)) {
+                turn_on(now());
+            }
+            break;
+        case 0xFF41:
+            stat = value & 0x78;
+            stat_changed(was_high);
+            break;
+        case 0xFF42: scy = value; break;
+        case 0xFF43: scx = value; break;
+        case 0xFF44: break;     // read only
+        case 0xFF45:
+            lyc = value;
+            stat_changed(was_high);
+            break;
+        case 0xFF46: dma = value; break;
+        case 0xFF47: bgp = value; break;
+        case 0xFF48: obp0 = value; break;
+        case 0xFF49: obp1 = value; break;
+        case 0xFF4A: wy = value; break;
+        case 0xFF4B: wx = value; break;
+    }
+    if (pixels) {
+        forward(address, value);
+    }
+}
+
+// VRAM, OAM and the registers. The VBlank and STAT events are saved with
+// the scheduler. The renderer's copy is rebuilt on load; only its window
+// row counter is saved, its framebuffer is output only. The render interval
+// is a setting of the instance, not part of its state, so without drawing
+// the next line to draw is saved as the start of the next frame.
+typedef struct {
+    u8 lcdc, stat, scy, scx, lyc, dma, bgp, obp0, obp1, wy, wx;
+    u8 window_line;
+    u8 reserved[4];     // zeroed, so no padding is saved
+    u64 origin;
+    u64 next_draw;
+    u64 frame_count;
+} PpuState;
+
+size_t Ppu::state_size() const {
+    return sizeof(vram) + sizeof(oam) + sizeof(PpuState);
+}
+
+void Ppu::save_state(StateWriter& out) const {
+    renderer.flush();
+    out.pod(vram);
+    out.pod(oam);
+    out.pod(PpuState{lcdc, stat, scy, scx, lyc, dma, bgp, obp0, obp1, wy, wx,
+                     drawing ? renderer.window_row() : u8(0), {}, origin,
+                     interval ? next_draw : first_draw_after(now()), frame_count});
+}
+
+void Ppu::load_state(StateReader& in) {
+    PpuState state;
+    if (!in.pod(vram) || !in.pod(oam) || !in.pod(state)) {
+        return;
+    }
+    lcdc = state.lcdc;
+    stat = state.stat;
+    scy = state.scy;
+    scx = state.scx;
+    lyc = state.lyc;
+    dma = state.dma;
+    bgp = state.bgp;
+    obp0 = state.obp0;
+    obp1 = state.obp1;
+    wy = state.wy;
+    wx = state.wx;
+    origin = state.origin;
+    next_draw = state.next_draw;
+    frame_count = state.frame_count;
+    drawing = interval && frame_count % interval == 0;
+    reset_renderer(state.window_line);
+}
@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+
+#include "../headers/renderer.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Turns one row of a tile, its low and high bit planes, into 8 colour
+// indexes, leftmost pixel first. Each plane is spread over 8 bytes and
+// tested against one bit per byte, so all 8 pixels come out at once.
+static inline void decode_row(const u8* planes, u8* out) {
+#if defined(__SSE2__)
+    const __m128i bits = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    __m128i spread = _mm_unpacklo_epi64(_mm_set1_epi8(static_cast<char>(planes[0])),
+                                        _mm_set1_epi8(static_cast<char>(planes[1])));
+    __m128i set = _mm_cmpeq_epi8(_mm_and_si128(spread, bits), bits);
+    set = _mm_and_si128(set, _mm_set_epi64x(0x0202020202020202ll, 0x0101010101010101ll));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_or_si128(set, _mm_srli_si128(set, 8)));
+#elif defined(__ARM_NEON)
+    const uint8x8_t bits = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
+    uint8x8_t lo = vand_u8(vtst_u8(vdup_n_u8(planes[0]), bits), vdup_n_u8(1));
+    uint8x8_t hi = vand_u8(vtst_u8(vdup_n_u8(planes[1]), bits), vdup_n_u8(2));
+    vst1_u8(out, vorr_u8(lo, hi));
+#else
+    // Multiplying copies the byte 8 times, 9 bits apart; bit 7 of byte k
+    // of the product is then bit 7 - k of the plane.
+    const u64 spread = 0x8040201008040201ull;
+    const u64 top = 0x8080808080808080ull;
+    u64 lo = ((planes[0] * spread) & top) >> 7;
+    u64 hi = ((planes[1] * spread) & top) >> 6;
+    u64 pixels = lo | hi;
+    for (int i = 0; i < 8; i++) {
+        out[i] = static_cast<u8>(pixels >> (i * 8));
+    }
+#endif
+}
+
+Renderer::Renderer() {
+    std::memset(vram, 0, sizeof(vram));
+    std::memset(oam, 0, sizeof(oam));
+    std::memset(frame, 0, sizeof(frame));
+    std::fill(std::begin(tile_stale), std::end(tile_stale), true);
+}
+
+Renderer::~Renderer() {
+    set_threaded(false);
+}
+
+void Renderer::set_threaded(bool on) {
+    if (on == threaded()) {
+        return;
+    }
+    if (on) {
+        log.reset(new Entry[LOG_SIZE]);
+        produced = 0;
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        running.store(true, std::memory_order_release);
+        worker = std::thread(&Renderer::work, this);
+    } else {
+        flush();
+        running.store(false, std::memory_order_release);
+        worker.join();
+        log.reset();
+    }
+}
+
+void Renderer::write(u16 address, u8 value) {
+    push(Entry{address, value, ENTRY_WRITE}, false);
+}
+
+void Renderer::draw_line(u8 line) {
+    push(Entry{0, line, ENTRY_LINE}, true);
+}
+
+void Renderer::start_frame() {
+    push(Entry{0, 0, ENTRY_FRAME}, true);
+}
+
+void Renderer::push(Entry entry, bool now) {
+    if (!threaded()) {
+        apply(entry);
+        return;
+    }
+    while (produced - tail.load(std::memory_order_acquire) == LOG_SIZE) {
+        publish();
+        std::this_thread::yield();
+    }
+    log[produced & (LOG_SIZE - 1)] = entry;
+    produced++;
+    if (now || produced - head.load(std::memory_order_relaxed) >= PUBLISH_EVERY) {
+        publish();
+    }
+}
+
+void Renderer::publish() {
+    head.store(produced, std::memory_order_release);
+}
+
+void Renderer::flush() {
+    if (!threaded()) {
+        return;
+    }
+    publish();
+    while (tail.load(std::memory_order_acquire) != produced) {
+        std::this_thread::yield();
+    }
+}
+
+// The worker applies whatever has been published, then waits for more. It
+// spins briefly and then sleeps, so a paused instance costs no CPU.
+void Renderer::work() {
+    u32 idle = 0;
+    for (;;) {
+        size_t from = tail.load(std::memory_order_relaxed);
+        size_t to = head.load(std::memory_order_acquire);
+        if (from == to) {
+            if (!running.load(std::memory_order_acquire)) {
+                return;
+            }
+            if (++idle < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            continue;
+        }
+        idle = 0;
+        for (size_t i = from; i != to; i++) {
+            apply(log[i & (LOG_SIZE - 1)]);
+        }
+        tail.store(to, std::memory_order_release);
+    }
+}
+
+void Renderer::apply(const Entry& entry) {
+    if (entry.kind == ENTRY_LINE) {
+        render_line(entry.value);
+        return;
+    }
+    if (entry.kind == ENTRY_FRAME) {
+        window_line = 0;
+        return;
+    }
+    u16 address = entry.address;
+    u8 value = entry.value;
+    if (address < 0xA000) {
+        vram[address - 0x8000] = value;
+        if (address < 0x8000 + TILE_COUNT * 16) {
+            tile_stale[(address - 0x8000) >> 4] = true;
+        }
+        return;
+    }
+    if (address < 0xFEA0) {
+        oam[address - 0xFE00] = value;
+        return;
+    }
+    switch (address) {
+        case 0xFF40: lcdc = value; break;
+        case 0xFF42: scy = value; break;
+        case 0xFF43: scx = value; break;
+        case 0xFF47: bgp = value; break;
+        case 0xFF48: obp0 = value; break;
+        case 0xFF49: obp1 = value; break;
+        case 0xFF4A: wy = value; break;
+        case 0xFF4B: wx = value; break;
+    }
+}
+
+void Renderer::reset(const u8* vram_src, const u8* oam_src, const u8* lcd_regs, u8 window) {
+    flush();
+    std::memcpy(vram, vram_src, sizeof(vram));
+    std::memcpy(oam, oam_src, sizeof(oam));
+    lcdc = lcd_regs[0x0];
+    scy = lcd_regs[0x2];
+    scx = lcd_regs[0x3];
+    bgp = lcd_regs[0x7];
+    obp0 = lcd_regs[0x8];
+    obp1 = lcd_regs[0x9];
+    wy = lcd_regs[0xA];
+    wx = lcd_regs[0xB];
+    window_line = window;
+    std::fill(std::begin(tile_stale), std::end(tile_stale), true);
+}
+
+// Colour indexes of a tile, 0 being the one at 0x8000.
+const u8* Renderer::tile(u16 index) {
+    if (tile_stale[index]) {
+        const u8* planes = vram + index * 16;
+        for (int row = 0; row < 8; row++) {
+            decode_row(planes + row * 2, tiles[index] + row * 8);
+        }
+        tile_stale[index] = false;
+    }
+    return tiles[index];
+}
+
+// Colour indexes of row `row` of a background or window tile, addressed
+// from 0x8000 or signed from 0x9000 as LCDC bit 4 selects.
+const u8* Renderer::tile_row(u8 index, u8 row) {
+    u16 at = (lcdc & 0x10) ? index : 256 + static_cast<s8>(index);
+    return tile(at) + row * 8;
+}
+
+// Colour indexes of pixels x onwards of the line, from line y of the tile
+// map at VRAM offset map, starting scroll pixels into the map row.
+void Renderer::draw_tiles(u8* out, int x, u16 map, u8 y, u8 scroll) {
+    u8 pixels[LCD_WIDTH + 16];
+    int width = LCD_WIDTH - x;
+    int fine = scroll & 7;
+    int count = (fine + width + 7) / 8;
+    const u8* map_row = vram + map + (y >> 3) * 32;
+    for (int i = 0; i < count; i++) {
+        std::memcpy(pixels + i * 8, tile_row(map_row[((scroll >> 3) + i) & 31], y & 7), 8);
+    }
+    std::memcpy(out + x, pixels + fine, width);
+}
+
+// Up to 10 sprites per line. Where they overlap the one with the lower X,
+// then the lower OAM index, wins, even if it is then hidden behind the
+// background.
+void Renderer::draw_sprites(u8 line, const u8* bg, u8* out) {
+    int height = (lcdc & 0x04) ? 16 : 8;
+    u8 found[10];
+    int count = 0;
+    for (int i = 0; i < 40 && count < 10; i++) {
+        int top = oam[i * 4] - 16;
+        if (line >= top && line < top + height) {
+            found[count++] = static_cast<u8>(i);
+        }
+    }
+    // Insertion sort by X keeps OAM order among equal X without the buffer
+    // std::stable_sort allocates.
+    for (int i = 1; i < count; i++) {
+        u8 index = found[i];
+        int j = i;
+        for (; j > 0 && oam[found[j - 1] * 4 + 1] > oam[index * 4 + 1]; j--) {
+            found[j] = found[j - 1];
+        }
+        found[j] = index;
+    }
+
+    bool taken[LCD_WIDTH] = {};
+    for (int k = 0; k < count; k++) {
+        const u8* sprite = &oam[found[k] * 4];
+        u8 attr = sprite[3];
+        int row = line - (sprite[0] - 16);
+        if (attr & 0x40) {
+            row = height - 1 - row;
+        }
+        // The second tile of a tall sprite follows the first.
+        u8 index = height == 16 ? (sprite[2] & 0xFE) : sprite[2];
+        const u8* pixels = tile(index + (row >> 3)) + (row & 7) * 8;
+
+        u8 palette = (attr & 0x10) ? obp1 : obp0;
+        int left = sprite[1] - 8;
+        for (int i = 0; i < 8; i++) {
+            int x = left + ((attr & 0x20) ? 7 - i : i);
+            if (x < 0 || x >= LCD_WIDTH || taken[x] || pixels[i] == 0) {
+                continue;
+            }
+            taken[x] = true;
+            if ((attr & 0x80) && bg[x] != 0) {
+                continue;
+            }
+            out[x] = (palette >> (pixels[i] * 2)) & 3;
+        }
+    }
+}
+
+void Renderer::render_line(u8 line) {
+    u8 bg[LCD_WIDTH];
+    if (lcdc & 0x01) {
+        draw_tiles(bg, 0, (lcdc & 0x08) ? 0x1C00 : 0x1800, static_cast<u8>(scy + line), scx);
+        if ((lcdc & 0x20) && line >= wy && wx < LCD_WIDTH + 7) {
+            // WX below 7 moves the window's left edge off screen.
+            int x = wx - 7;
+            draw_tiles(bg, x < 0 ? 0 : x, (lcdc & 0x40) ? 0x1C00 : 0x1800, window_line,
+                       static_cast<u8>(x < 0 ? -x : 0));
+            window_line++;
+        }
+    } else {
+        std::memset(bg, 0, sizeof(bg));
+    }
+
+    // Selects rather than a table lookup, so the loop vectorizes.
+    u8 shade0 = bgp & 3;
+    u8 shade1 = (bgp >> 2) & 3;
+    u8 shade2 = (bgp >> 4) & 3;
+    u8 shade3 = bgp >> 6;
+    u8 shaded[LCD_WIDTH];
+    for (int x = 0; x < LCD_WIDTH; x++) {
+        u8 index = bg[x];
+        shaded[x] = index == 0 ? shade0 : index == 1 ? shade1 : index == 2 ? shade2 : shade3;
+    }
+    u8* out = frame + line * LCD_WIDTH;
+    std::memcpy(out, shaded, LCD_WIDTH);
+    if (lcdc & 0x02) {
+        draw_sprites(line, bg, out);
+    }
+}
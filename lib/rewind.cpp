@@ -0,0 +1,200 @@
+#include <cstring>
+
+#include "../headers/rewind.hpp"
+#include "../headers/save_state.hpp"
+#include "../headers/cpu.hpp"
+#include "../headers/bus.hpp"
+#include "../headers/timer.hpp"
+#include "../headers/scheduler.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Deltas are a sequence of runs, each a header word holding the number of
+// unchanged words to skip (high half) and the number of changed words that
+// follow (low half), then those words XORed with the previous state.
+
+static u64 load_word(const u8* p) {
+    u64 w;
+    std::memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+// Number of equal words from the start of a and b, at most words. Compares
+// 16 bytes at a time where the host has vector registers.
+static size_t equal_words(const u8* a, const u8* b, size_t words) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 2 <= words; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i * 8));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i * 8));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF) {
+            break;
+        }
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 2 <= words; i += 2) {
+        uint8x16_t ne = veorq_u8(vld1q_u8(a + i * 8), vld1q_u8(b + i * 8));
+        uint64x2_t ne64 = vreinterpretq_u64_u8(ne);
+        if ((vgetq_lane_u64(ne64, 0) | vgetq_lane_u64(ne64, 1)) != 0) {
+            break;
+        }
+    }
+#endif
+    while (i < words && load_word(a + i * 8) == load_word(b + i * 8)) {
+        i++;
+    }
+    return i;
+}
+
+static void encode(const u8* cur, const u8* prev, size_t words, std::vector<u64>& out) {
+    out.clear();
+    size_t i = 0;
+    while (i < words) {
+        size_t skip = equal_words(cur + i * 8, prev + i * 8, words - i);
+        i += skip;
+        size_t header = out.size();
+        out.push_back(static_cast<u64>(skip) << 32);
+        while (i < words) {
+            u64 x = load_word(cur + i * 8) ^ load_word(prev + i * 8);
+            if (x == 0) {
+                break;
+            }
+            out.push_back(x);
+            i++;
+        }
+        out[header] |= out.size() - header - 1;
+    }
+}
+
+// XORs a delta into state. Applying it to either of the two states it was
+// made from gives the other.
+static void apply_delta(const std::vector<u64>& delta, u8* state) {
+    size_t at = 0;
+    for (size_t r = 0; r < delta.size();) {
+        u64 header = delta[r++];
+        at += header >> 32;
+        size_t count = static_cast<u32>(header);
+        for (size_t k = 0; k < count; k++, at++) {
+            u64 w = load_word(state + at * 8) ^ delta[r++];
+            std::memcpy(state + at * 8, &w, sizeof(w));
+        }
+    }
+}
+
+Rewind::Rewind(u32 interval_frames, u32 keyframe_every, size_t max_bytes)
+    : interval(static_cast<u64>(interval_frames ? interval_frames : 1) * FRAME_CYCLES),
+      keyframe_every(keyframe_every ? keyframe_every : 1),
+      max_bytes(max_bytes) {}
+
+void Rewind::clear() {
+    entries.clear();
+    used = 0;
+    since_keyframe = 0;
+    next_capture = 0;
+    state_bytes = 0;
+    newest.clear();
+}
+
+void Rewind::update(const gbCpu& cpu, const Bus& bus, const Timer& timer, const Scheduler& sched) {
+    if (sched.now() >= next_capture) {
+        capture(cpu, bus, timer, sched);
+    }
+}
+
+void Rewind::capture(const gbCpu& cpu, const Bus& bus, const Timer& timer, const Scheduler& sched) {
+    save_state(cpu, bus, timer, sched, scratch);
+    size_t size = scratch.size();
+    size_t padded = (size + 7) & ~static_cast<size_t>(7);
+    scratch.resize(padded);
+    if (size != state_bytes) {
+        // A different cartridge; the old history cannot be diffed against.
+        clear();
+        state_bytes = size;
+        zero.assign(padded, 0);
+    }
+
+    Entry entry;
+    entry.keyframe = entries.empty() || since_keyframe + 1 >= keyframe_every;
+    encode(scratch.data(), entry.keyframe ? zero.data() : newest.data(), padded / 8, entry.delta);
+    since_keyframe = entry.keyframe ? 0 : since_keyframe + 1;
+    used += entry.delta.size() * sizeof(u64);
+    entries.push_back(std::move(entry));
+    newest.swap(scratch);
+    next_capture = sched.now() + interval;
+
+    while (used > max_bytes && evict()) {
+    }
+    if (used > max_bytes) {
+        // Only the newest segment is left. Start a new one with the next
+        // capture so this one can be dropped then.
+        since_keyframe = keyframe_every - 1;
+    }
+}
+
+// Drops the oldest keyframe and the deltas that depend on it, but never
+// the segment holding the newest capture. Returns false if nothing could
+// be dropped.
+bool Rewind::evict() {
+    size_t end = 1;
+    while (end < entries.size() && !entries[end].keyframe) {
+        end++;
+    }
+    if (end >= entries.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < end; i++) {
+        used -= entries.front().delta.size() * sizeof(u64);
+        entries.pop_front();
+    }
+    return true;
+}
+
+bool Rewind::step_back(u32 count, gbCpu& cpu, Bus& bus, Timer& timer, Scheduler& sched) {
+    if (entries.empty()) {
+        return false;
+    }
+    size_t last = entries.size() - 1;
+    size_t target = count > last ? 0 : last - count;
+
+    size_t keyframe = target;
+    while (!entries[keyframe].keyframe) {
+        keyframe--;
+    }
+    size_t newest_keyframe = last;
+    while (!entries[newest_keyframe].keyframe) {
+        newest_keyframe--;
+    }
+    if (keyframe == newest_keyframe && last - target <= target - keyframe) {
+        // Nearer the newest capture than the keyframe: undo deltas instead.
+        for (size_t i = last; i > target; i--) {
+            apply_delta(entries[i].delta, newest.data());
+        }
+    } else {
+        std::memset(newest.data(), 0, newest.size());
+        for (size_t i = keyframe; i <= target; i++) {
+            apply_delta(entries[i].delta, newest.data());
+        }
+    }
+
+    while (entries.size() > target + 1) {
+        used -= entries.back().delta.size() * sizeof(u64);
+        entries.pop_back();
+    }
+    since_keyframe = static_cast<u32>(target - keyframe);
+    restore(newest, cpu, bus, timer, sched);
+    next_capture = sched.now() + interval;
+    return true;
+}
+
+// load_state wants the exact size; the padding is zero and comes back on
+// the resize.
+void Rewind::restore(std::vector<u8>& state, gbCpu& cpu, Bus& bus, Timer& timer, Scheduler& sched) {
+    size_t padded = state.size();
+    state.resize(state_bytes);
+    load_state(cpu, bus, timer, sched, state);
+    state.resize(padded);
+}
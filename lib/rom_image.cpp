@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+#include "../headers/rom_image.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ZENBOY_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Images that are still in use, by file identity: device and inode where
+// available, else the path.
+static std::mutex registry_mutex;
+static std::map<std::string, std::weak_ptr<const RomImage>> registry;
+
+static bool is_bank_aligned(size_t size) {
+    return size >= 0x8000 && (size & 0x3FFF) == 0;
+}
+
+RomImage::~RomImage() {
+#ifdef ZENBOY_HAVE_MMAP
+    if (mapping) {
+        munmap(mapping, length);
+    }
+#endif
+}
+
+std::shared_ptr<const RomImage> RomImage::open(const std::string& path) {
+    std::string key = path;
+#ifdef ZENBOY_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: Unable to open ROM file " << path << std::endl;
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        std::cerr << "Error: Failed to read ROM file " << path << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    key = std::to_string(st.st_dev) + ":" + std::to_string(st.st_ino);
+#endif
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto it = registry.find(key);
+    if (it != registry.end()) {
+        if (std::shared_ptr<const RomImage> image = it->second.lock()) {
+#ifdef ZENBOY_HAVE_MMAP
+            close(fd);
+#endif
+            return image;
+        }
+    }
+
+    std::shared_ptr<RomImage> image(new RomImage());
+#ifdef ZENBOY_HAVE_MMAP
+    size_t size = static_cast<size_t>(st.st_size);
+    if (is_bank_aligned(size)) {
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            image->mapping = mapping;
+            image->bytes = static_cast<const u8*>(mapping);
+            image->length = size;
+        }
+    }
+    close(fd);
+#endif
+
+    if (!image->mapping) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            std::cerr << "Error: Unable to open ROM file " << path << std::endl;
+            return nullptr;
+        }
+        std::streamsize file_size = file.tellg();
+        image->copy.resize(static_cast<size_t>(file_size));
+        file.seekg(0, std::ios::beg);
+        if (!file.read(reinterpret_cast<char*>(image->copy.data()), file_size)) {
+            std::cerr << "Error: Failed to read ROM file " << path << std::endl;
+            return nullptr;
+        }
+        if (image->copy.empty()) {
+            std::cerr << "Error: ROM file " << path << " is empty" << std::endl;
+            return nullptr;
+        }
+        // Whole 16 KiB banks, at least the two that are mapped at once.
+        size_t padded = std::max<size_t>((image->copy.size() + 0x3FFF) & ~size_t(0x3FFF), 0x8000);
+        image->copy.resize(padded, 0xFF);
+        image->bytes = image->copy.data();
+        image->length = image->copy.size();
+    }
+
+    u32 hash = 2166136261u;
+    for (size_t i = 0; i < image->length; i++) {
+        hash = (hash ^ image->bytes[i]) * 16777619u;
+    }
+    image->checksum = hash;
+
+    for (auto entry = registry.begin(); entry != registry.end();) {
+        entry = entry->second.expired() ? registry.erase(entry) : std::next(entry);
+    }
+    registry[key] = image;
+    return image;
+}
@@ -0,0 +1,48 @@
+#include "../headers/save_state.hpp"
+#include "../headers/cpu.hpp"
+#include "../headers/bus.hpp"
+#include "../headers/timer.hpp"
+#include "../headers/scheduler.hpp"
+
+static const u16 HOST_ENDIAN = 0x0102;
+
+static size_t state_size(const gbCpu& cpu, const Bus& bus, const Timer& timer, const Scheduler& sched) {
+    return sizeof(SaveStateHeader) + cpu.state_size() + timer.state_size() + sched.state_size() +
+           bus.state_size();
+}
+
+void save_state(const gbCpu& cpu, const Bus& bus, const Timer& timer, const Scheduler& sched,
+                std::vector<u8>& out) {
+    size_t size = state_size(cpu, bus, timer, sched);
+    out.clear();
+    out.reserve(size);
+
+    StateWriter writer(out);
+    writer.pod(SaveStateHeader{SAVE_STATE_MAGIC, SAVE_STATE_VERSION, HOST_ENDIAN,
+                               static_cast<u32>(size), static_cast<u32>(bus.cart_ram_size()),
+                               static_cast<u32>(bus.rom_size()), bus.rom_hash()});
+    cpu.save_state(writer);
+    timer.save_state(writer);
+    sched.save_state(writer);
+    bus.save_state(writer);
+}
+
+bool load_state(gbCpu& cpu, Bus& bus, Timer& timer, Scheduler& sched, const std::vector<u8>& in) {
+    StateReader reader(in.data(), in.size());
+    SaveStateHeader header;
+    if (!reader.pod(header) || header.magic != SAVE_STATE_MAGIC ||
+        header.version != SAVE_STATE_VERSION || header.endian != HOST_ENDIAN ||
+        header.cart_ram_size != bus.cart_ram_size() || header.rom_size != bus.rom_size() ||
+        header.rom_hash != bus.rom_hash() || header.size != in.size() ||
+        header.size != state_size(cpu, bus, timer, sched)) {
+        return false;
+    }
+
+    // Every section has a known size, checked above, so the reads below
+    // cannot come up short.
+    cpu.load_state(reader);
+    timer.load_state(reader);
+    sched.load_state(reader);
+    bus.load_state(reader);
+    return reader.good();
+}
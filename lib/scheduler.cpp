@@ -0,0 +1,90 @@
+#include <algorithm>
+
+#include "../headers/scheduler.hpp"
+
+// Orders the heap so the earliest deadline is at the front.
+static bool later(const Scheduler::Event& a, const Scheduler::Event& b) {
+    return a.when > b.when;
+}
+
+Scheduler::Scheduler() {
+    std::fill(std::begin(deadlines), std::end(deadlines), NEVER);
+    std::fill(std::begin(handlers), std::end(handlers), nullptr);
+    std::fill(std::begin(contexts), std::end(contexts), nullptr);
+}
+
+void Scheduler::set_handler(EventType type, EventHandler handler, void* ctx) {
+    handlers[static_cast<size_t>(type)] = handler;
+    contexts[static_cast<size_t>(type)] = ctx;
+}
+
+void Scheduler::schedule(EventType type, u64 when) {
+    if (heap.size() >= MAX_HEAP) {
+        compact();
+    }
+    deadlines[static_cast<size_t>(type)] = when;
+    heap.push_back(Event{when, type});
+    std::push_heap(heap.begin(), heap.end(), later);
+    update_next();
+}
+
+void Scheduler::cancel(EventType type) {
+    deadlines[static_cast<size_t>(type)] = NEVER;
+    update_next();
+}
+
+// Rebuilds the heap from the live deadlines when rescheduling has filled it
+// with stale entries.
+void Scheduler::compact() {
+    heap.clear();
+    for (size_t type = 0; type < static_cast<size_t>(EventType::COUNT); type++) {
+        if (deadlines[type] != NEVER) {
+            heap.push_back(Event{deadlines[type], static_cast<EventType>(type)});
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+}
+
+// Drops stale entries from the top of the heap and caches the earliest live
+// deadline.
+void Scheduler::update_next() {
+    while (!heap.empty() && heap.front().when != deadlines[static_cast<size_t>(heap.front().type)]) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        heap.pop_back();
+    }
+    next = heap.empty() ? NEVER : heap.front().when;
+}
+
+// Events run in deadline order. A handler may schedule its type again, even
+// for a deadline that has already passed; it then runs in the same call.
+void Scheduler::run_due() {
+    while (next <= cycle) {
+        Event event = heap.front();
+        std::pop_heap(heap.begin(), heap.end(), later);
+        heap.pop_back();
+
+        size_t type = static_cast<size_t>(event.type);
+        deadlines[type] = NEVER;
+        update_next();
+        if (handlers[type]) {
+            handlers[type](contexts[type], event.when);
+        }
+    }
+}
+
+// The clock and the live deadlines; handlers stay as registered.
+size_t Scheduler::state_size() const {
+    return sizeof(cycle) + sizeof(deadlines);
+}
+
+void Scheduler::save_state(StateWriter& out) const {
+    out.pod(cycle);
+    out.pod(deadlines);
+}
+
+void Scheduler::load_state(StateReader& in) {
+    in.pod(cycle);
+    in.pod(deadlines);
+    compact();
+    update_next();
+}
@@ -1,22 +1,51 @@
+#include <cstdint>
+
 #include "timer.hpp"
 #include "cpu.hpp"
+#include "scheduler.hpp"
+#include "save_state.hpp"
 
 void Timer::set_cpu(gbCpu* cpu_ptr) {
     cpu = cpu_ptr;
 }
 
-void Timer::emu_cycles(int cycles) {
-    for (int i = 0; i < cycles; i++) {
-        timer_tick();
-    }
+// The timer only does work when its registers are accessed and when TIMA
+// overflows; the scheduler holds the overflow deadline.
+void Timer::set_scheduler(Scheduler* sched_ptr) {
+    sync();
+    u16 div = div_counter();
+    sched = sched_ptr;
+    set_div_counter(div);
+    sched->set_handler(EventType::TIMER_OVERFLOW, &Timer::on_overflow, this);
+    schedule_overflow();
 }
+
 void Timer::timer_init() {
-    div  = 0xAC00;
+    set_div_counter(0xAC00);
     tac  = 0x00;
     tima = 0x00;
     tma  = 0x00;
 }
 
+// T-cycles since power on; the scheduler counts M-cycles.
+uint64_t Timer::now_ticks() const {
+    return sched ? sched->now() * 4 : 0;
+}
+
+// Divider value without the 16-bit wrap, so falling edges can be counted by
+// division.
+uint64_t Timer::counter() const {
+    return now_ticks() - div_origin;
+}
+
+u16 Timer::div_counter() const {
+    return static_cast<u16>(counter());
+}
+
+void Timer::set_div_counter(u16 value) {
+    div_origin = now_ticks() - value;
+    tima_counter = value;
+}
 
 int Timer::timer_bit() const {
     switch (tac & 0x03) {
@@ -28,43 +57,70 @@ int Timer::timer_bit() const {
     return 9;
 }
 
-void Timer::timer_step() {
-    if (tima == 0xFF) {
-        tima = tma;
-        if (cpu) {
-            cpu->request_interrupt(IT_TIMER);
-        }
-    } else {
-        tima++;
+// M-cycles until TIMA overflows and requests IT_TIMER, UINT32_MAX while stopped.
+// TIMA must be current (see sync).
+u32 Timer::cycles_until_overflow() const {
+    if (!(tac & 0x04)) {
+        return UINT32_MAX;
     }
+    u32 period = 1u << (timer_bit() + 1);
+    u32 first_edge = period - (counter() & (period - 1));
+    return (first_edge + (0xFF - tima) * period + 3) / 4;
 }
 
-void Timer::timer_tick() {
-    int bit = timer_bit();
+// Steps TIMA `edges` times. Every wrap reloads TMA and requests IT_TIMER.
+void Timer::add_tima(uint64_t edges) {
+    if (edges < 0x100u - tima) {
+        tima += edges;
+        return;
+    }
+    edges -= 0x100u - tima;
+    tima = tma + edges % (0x100u - tma);
+    if (cpu) {
+        cpu->request_interrupt(IT_TIMER);
+    }
+}
 
-    bool prev = (div >> bit) & 1;
-    div++;
-    bool curr = (div >> bit) & 1;
+// Applies the TIMA increments since the last sync: one per falling edge of
+// the selected divider bit, i.e. per multiple of 2^(bit+1) passed.
+void Timer::sync() {
+    uint64_t now = counter();
+    if (tac & 0x04) {
+        int shift = timer_bit() + 1;
+        add_tima((now >> shift) - (tima_counter >> shift));
+    }
+    tima_counter = now;
+}
 
+void Timer::schedule_overflow() {
+    if (!sched) {
+        return;
+    }
     if (tac & 0x04) {
-        if (prev && !curr) {
-            timer_step();
-        }
+        sched->schedule(EventType::TIMER_OVERFLOW, sched->now() + cycles_until_overflow());
+    } else {
+        sched->cancel(EventType::TIMER_OVERFLOW);
     }
 }
 
+void Timer::on_overflow(void* ctx, uint64_t) {
+    Timer* timer = static_cast<Timer*>(ctx);
+    timer->sync();
+    timer->schedule_overflow();
+}
+
 void Timer::timer_write(u16 address, u8 value) {
+    sync();
     switch (address) {
         case 0xFF04: {
-            int bit = timer_bit();
-            bool prev = (div >> bit) & 1;
-
-            div = 0;
+            // Resetting the divider is a falling edge if the selected bit
+            // was set.
+            bool prev = (div_counter() >> timer_bit()) & 1;
 
-            bool curr = 0;
+            set_div_counter(0);
 
-            if ((tac & 0x04) && prev && !curr) {
-                timer_step();
+            if ((tac & 0x04) && prev) {
+                add_tima(1);
             }
             break;
         }
@@ -82,12 +138,14 @@ void Timer::timer_write(u16 address, u8 value) {
             tac = value & 0x07;
             break;
     }
+    schedule_overflow();
 }
 
 u8 Timer::timer_read(u16 address) {
+    sync();
     switch (address) {
         case 0xFF04: // DIV
-            return div >> 8;
+            return div_counter() >> 8;
         case 0xFF05: // TIMA
             return tima;
         case 0xFF06: // TMA
@@ -98,3 +156,35 @@ u8 Timer::timer_read(u16 address) {
             return 0x00;
     }
 }
+
+// Timer registers. div_origin and tima_counter count from the scheduler's
+// clock, which is saved alongside, and the overflow deadline is a scheduler
+// event, so nothing needs recomputing on load.
+typedef struct {
+    uint64_t div_origin;
+    uint64_t tima_counter;
+    u8 tima;
+    u8 tma;
+    u8 tac;
+    u8 reserved[5];     // zeroed, so no padding is saved
+} TimerState;
+
+size_t Timer::state_size() const {
+    return sizeof(TimerState);
+}
+
+void Timer::save_state(StateWriter& out) const {
+    out.pod(TimerState{div_origin, tima_counter, tima, tma, tac});
+}
+
+void Timer::load_state(StateReader& in) {
+    TimerState state;
+    if (!in.pod(state)) {
+        return;
+    }
+    div_origin = state.div_origin;
+    tima_counter = state.tima_counter;
+    tima = state.tima;
+    tma = state.tma;
+    tac = state.tac;
+}
@@ -0,0 +1,52 @@
+#include <cstring>
+#include <iostream>
+
+#include "../headers/trace.hpp"
+
+bool parse_trace_level(const char* name, TraceLevel& level) {
+    if (std::strcmp(name, "off") == 0) {
+        level = TraceLevel::OFF;
+    } else if (std::strcmp(name, "serial") == 0) {
+        level = TraceLevel::SERIAL;
+    } else if (std::strcmp(name, "instr") == 0) {
+        level = TraceLevel::INSTRUCTION;
+    } else {
+        return false;
+    }
+    if (level > TRACE_MAX_LEVEL) {
+        std::cerr << "Warning: trace level " << name << " not compiled in (ZENBOY_TRACE_LEVEL="
+                  << ZENBOY_TRACE_LEVEL << ")" << std::endl;
+    }
+    return true;
+}
+
+Trace::Trace(TraceLevel level) : level(level) {}
+
+Trace::~Trace() {
+    flush_serial();
+}
+
+std::ostream& Trace::out() {
+    return output ? *output : std::cerr;
+}
+
+// Test ROMs print their results over the serial port; show them a line at
+// a time.
+void Trace::serial(u8 byte) {
+    if (!enabled<TraceLevel::SERIAL>()) {
+        return;
+    }
+    if (byte == '\n') {
+        flush_serial();
+        return;
+    }
+    serial_line += static_cast<char>(byte);
+}
+
+void Trace::flush_serial() {
+    if (serial_line.empty()) {
+        return;
+    }
+    out() << "Serial: " << serial_line << std::endl;
+    serial_line.clear();
+}
@@ -0,0 +1,65 @@
+#include <thread>
+
+#include "../headers/work_pool.hpp"
+
+WorkPool::WorkPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+}
+
+// Own queue first, newest job first; then the oldest job of the next
+// non-empty queue.
+bool WorkPool::take(unsigned worker, size_t& index) {
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.lock);
+        if (!own.jobs.empty()) {
+            index = own.jobs.back();
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+    for (unsigned i = 1; i < queues.size(); i++) {
+        Queue& victim = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.lock);
+        if (!victim.jobs.empty()) {
+            index = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+// No job is queued once run() has started, so a worker that finds every
+// queue empty is done.
+void WorkPool::work(unsigned worker, PoolJob job, void* ctx) {
+    size_t index;
+    while (take(worker, index)) {
+        job(ctx, index);
+    }
+}
+
+void WorkPool::run(size_t count, PoolJob job, void* ctx) {
+    // Jobs are dealt out in reverse so each worker starts on the lowest
+    // index it holds.
+    for (size_t i = count; i-- > 0;) {
+        queues[i % queues.size()]->jobs.push_back(i);
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned worker = 1; worker < queues.size(); worker++) {
+        threads.emplace_back(&WorkPool::work, this, worker, job, ctx);
+    }
+    work(0, job, ctx);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
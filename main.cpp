@@ -1,7 +1,24 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+
 #include "headers/emu.hpp"
 
-int main()
+int main(int argc, char** argv)
 {
-    Emulator main_emu;
-    main_emu.run_emu(true);
-}
\ No newline at end of file
+    TraceLevel trace_level = TraceLevel::SERIAL;
+    std::string rom_path = "../../roms/02-interrupts.gb";
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            if (!parse_trace_level(argv[++i], trace_level)) {
+                std::cerr << "Error: unknown trace level " << argv[i] << " (off, serial, instr)" << std::endl;
+                return 1;
+            }
+        } else {
+            rom_path = argv[i];
+        }
+    }
+
+    Emulator main_emu(trace_level);
+    return main_emu.run_emu(rom_path);
+}